@@ -8,7 +8,8 @@ public class NBodySim : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 	
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "Niagara" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "Niagara",
+			"NiagaraCore", "VectorVM" });
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
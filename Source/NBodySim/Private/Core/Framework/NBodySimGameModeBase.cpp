@@ -9,7 +9,8 @@ void ANBodySimGameModeBase::BeginPlay()
 {
 	Super::BeginPlay();
 	const TObjectPtr<UNBodySimulationSubsystem> NBodySubsystem = GetWorld()->GetSubsystem<UNBodySimulationSubsystem>();
-	NBodySubsystem->InitializeDefaults(DefaultRenderer, NumStaringBodies, AccuracyCoefficient, MinimumBodyMass, MaximumBodyMass, bShouldAutoLoad);
+	NBodySubsystem->InitializeDefaults(DefaultRenderer, NumStaringBodies, AccuracyCoefficient, MinimumBodyMass,
+	                                   MaximumBodyMass, bShouldAutoLoad, Solver);
 	NBodySubsystem->StartSimulation();
 }
 
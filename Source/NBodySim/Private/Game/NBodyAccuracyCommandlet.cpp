@@ -0,0 +1,239 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Game/NBodyAccuracyCommandlet.h"
+#include "NBodyBenchmarkUtils.h"
+#include "Game/NBodySimulationSubsystem.h"
+#include "Engine/Engine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogNBodyAccuracy, Log, All);
+
+namespace NBodyAccuracy
+{
+	// Same body masses as the game mode defaults
+	constexpr float MinBodyMass = 30;
+	constexpr float MaxBodyMass = 130;
+
+	constexpr float StepDeltaTime = 1.f / 60.f;
+
+	/**
+	 * @brief Value below which Percentile of the sorted values fall, nearest rank.
+	 */
+	double GetPercentile(const TArray<double>& SortedValues, const double Percentile)
+	{
+		const int Rank = FMath::CeilToInt(Percentile / 100.0 * SortedValues.Num()) - 1;
+		return SortedValues[FMath::Clamp(Rank, 0, SortedValues.Num() - 1)];
+	}
+}
+
+UNBodyAccuracyCommandlet::UNBodyAccuracyCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UNBodyAccuracyCommandlet::Main(const FString& Params)
+{
+	using namespace NBodyAccuracy;
+	using namespace NBodyBenchmarkUtils;
+
+	const TArray<float> Coefficients = ParseList<float>(
+		Params, TEXT("Coefficients="), {0.3f, 0.5f, 0.7f, 1.0f, 1.2f, 1.5f});
+
+	int NumBodies = 10000;
+	int NumWarmupSteps = 0;
+	int GridSize = 256;
+	int32 Seed = 1234;
+	float WorldSize = 4096;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("NBodyAccuracy.csv");
+	FParse::Value(*Params, TEXT("Bodies="), NumBodies);
+	FParse::Value(*Params, TEXT("WarmupSteps="), NumWarmupSteps);
+	FParse::Value(*Params, TEXT("GridSize="), GridSize);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("WorldSize="), WorldSize);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	EBodyDistribution Distribution = EBodyDistribution::Uniform;
+	FString DistributionName;
+	if (FParse::Value(*Params, TEXT("Distribution="), DistributionName) &&
+		!FBodyDistribution::FromString(DistributionName, Distribution))
+	{
+		UE_LOG(LogNBodyAccuracy, Error, TEXT("Unknown distribution %s"), *DistributionName);
+		return 1;
+	}
+
+	if (Coefficients.Num() == 0 || NumBodies < 2)
+	{
+		UE_LOG(LogNBodyAccuracy, Error, TEXT("Needs at least one coefficient & 2 bodies."));
+		return 1;
+	}
+
+	const FQuadrantBounds Bounds(-WorldSize * 0.5f, WorldSize * 0.5f, -WorldSize * 0.5f, WorldSize * 0.5f);
+
+	// The subsystem lives in a world that's never ticked, it only advances when stepped below
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("NBodyAccuracyWorld"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	UNBodySimulationSubsystem* Subsystem = World->GetSubsystem<UNBodySimulationSubsystem>();
+	check(Subsystem);
+
+	Subsystem->InitializeDefaults(nullptr, NumBodies, Coefficients[0], MinBodyMass, MaxBodyMass, false);
+	const int NumWorkers = FTaskGraphInterface::Get().GetNumBackgroundThreads() + 1;
+	Subsystem->StartHeadless(Bounds, Seed, NumWorkers, Distribution);
+	for (int Step = 0; Step < NumWarmupSteps; Step++)
+		Subsystem->StepSimulation(StepDeltaTime);
+
+	// Snapshot, every coefficient is measured against the same bodies & the same tree, with & without moments
+	Subsystem->BatchAndWaitBuildTree(StepDeltaTime);
+
+	const double MomentsStartTime = FPlatformTime::Seconds();
+	Subsystem->UpdateQuadrupoles();
+	const double MomentsSeconds = FPlatformTime::Seconds() - MomentsStartTime;
+
+	const TQuadTreeView QuadrupoleTree = Subsystem->GetTreeView();
+	TQuadTreeView MonopoleTree = QuadrupoleTree;
+	MonopoleTree.Quadrupoles = nullptr;
+
+	TArray<FBodyDescriptor> Snapshot;
+	Snapshot.SetNumUninitialized(NumBodies);
+	for (int i = 0; i < NumBodies; i++)
+	{
+		Snapshot[i] = Subsystem->GetBody(i);
+		Snapshot[i].Velocity = FVector2f(0);
+		Snapshot[i].SimCost = 0;
+	}
+
+	// Exact reference, in double so it's not limited by the same rounding as the tree walk
+	TArray<FVector2D> Exact;
+	Exact.SetNumUninitialized(NumBodies);
+
+	const double ExactStartTime = FPlatformTime::Seconds();
+	ParallelFor(NumBodies, [&](const int i)
+	{
+		const FVector2D Location = FVector2D(Snapshot[i].Location);
+		FVector2D Velocity(0);
+		for (int j = 0; j < NumBodies; j++)
+		{
+			if (j == i)
+				continue;
+
+			const FVector2D Dist = FVector2D(Snapshot[j].Location) - Location;
+			Velocity += Dist * (Snapshot[j].Mass / Dist.SizeSquared());
+		}
+		Exact[i] = Velocity;
+	});
+	const double ExactSeconds = FPlatformTime::Seconds() - ExactStartTime;
+
+	TArray<FString> Lines;
+	// SolverMs excludes the tree build, MomentsMs is what quadrupoles add to it
+	Lines.Add(TEXT("Solver,Coefficient,Quadrupoles,Bodies,Distribution,MedianRelativeError,P99RelativeError,")
+		TEXT("MaxRelativeError,InteractionsPerBody,SolverMs,MomentsMs,ExactMs"));
+
+	TArray<double> RelativeErrors;
+	RelativeErrors.SetNumUninitialized(NumBodies);
+
+	// Compares every body's approximate velocity change, by spawn index, against the exact one & adds a row
+	auto AddResult = [&](const TCHAR* Solver, const float Coefficient, const bool bQuadrupoles,
+	                     const TFunctionRef<FVector2f(int)> GetVelocity, const double TotalInteractions,
+	                     const double SolverSeconds, const double ExtraSeconds)
+	{
+		for (int i = 0; i < NumBodies; i++)
+		{
+			const double ExactLength = Exact[i].Size();
+			const double ErrorLength = (FVector2D(GetVelocity(i)) - Exact[i]).Size();
+			RelativeErrors[i] = ExactLength > 0 ? ErrorLength / ExactLength : 0;
+		}
+		RelativeErrors.Sort();
+
+		const FString Line = FString::Printf(TEXT("%s,%f,%d,%d,%s,%e,%e,%e,%f,%f,%f,%f"), Solver, Coefficient,
+			bQuadrupoles ? 1 : 0, NumBodies, FBodyDistribution::ToString(Distribution),
+			GetPercentile(RelativeErrors, 50), GetPercentile(RelativeErrors, 99), RelativeErrors.Last(),
+			TotalInteractions / NumBodies, SolverSeconds * 1000, ExtraSeconds * 1000, ExactSeconds * 1000);
+
+		UE_LOG(LogNBodyAccuracy, Display, TEXT("%s"), *Line);
+		Lines.Add(Line);
+	};
+
+	for (const float Coefficient : Coefficients)
+	{
+		Subsystem->SetAccuracyCoefficient(Coefficient);
+
+		for (const bool bQuadrupoles : {false, true})
+		{
+			const TQuadTreeView& Tree = bQuadrupoles ? QuadrupoleTree : MonopoleTree;
+
+			TArray<FBodyDescriptor> Approximate = Snapshot;
+			const double StartTime = FPlatformTime::Seconds();
+			// Snapshots are in spawn order, the tree knows bodies by where they're stored
+			ParallelFor(NumBodies, [&](const int i)
+			{
+				const int BodyIndex = Subsystem->GetBodyStorageIndex(i);
+				Subsystem->CalculateBodyVelocity(StepDeltaTime, Approximate[i], BodyIndex, Tree);
+			});
+			const double BarnesHutSeconds = FPlatformTime::Seconds() - StartTime;
+
+			double TotalInteractions = 0;
+			for (const FBodyDescriptor& Body : Approximate)
+				TotalInteractions += Body.SimCost;
+
+			AddResult(TEXT("BarnesHut"), Coefficient, bQuadrupoles,
+			          [&Approximate](const int i) { return Approximate[i].Velocity; }, TotalInteractions,
+			          BarnesHutSeconds, bQuadrupoles ? MomentsSeconds : 0);
+		}
+	}
+
+	// Particle mesh bodies are in storage order, the order the TreePM short range walk knows them by
+	FBodyArray MeshBodies;
+	MeshBodies.AddZeroed(NumBodies);
+	for (int i = 0; i < NumBodies; i++)
+		MeshBodies.Set(Subsystem->GetBodyStorageIndex(i), Snapshot[i]);
+
+	FParticleMeshSolver ParticleMeshSolver;
+	ParticleMeshSolver.SetGridSize(GridSize);
+
+	// Plain PM, then TreePM at every coefficient, each timed after a first solve has built its kernel
+	for (const bool bShortRange : {false, true})
+	{
+		const TCHAR* Solver = bShortRange ? TEXT("TreePM") : TEXT("ParticleMesh");
+		const TQuadTreeView* ShortRangeTree = bShortRange ? &MonopoleTree : nullptr;
+		{
+			FBodyArray KernelBodies = MeshBodies;
+			ParticleMeshSolver.Solve(KernelBodies, Bounds, NumWorkers, ShortRangeTree, Coefficients[0]);
+		}
+
+		for (const float Coefficient : Coefficients)
+		{
+			FBodyArray Approximate = MeshBodies;
+			const double StartTime = FPlatformTime::Seconds();
+			const int64 NumInteractions = ParticleMeshSolver.Solve(Approximate, Bounds, NumWorkers, ShortRangeTree,
+			                                                       Coefficient);
+			const double MeshSeconds = FPlatformTime::Seconds() - StartTime;
+
+			AddResult(Solver, bShortRange ? Coefficient : 0, false, [&](const int i)
+			{
+				return Approximate.GetVelocity(Subsystem->GetBodyStorageIndex(i));
+			}, NumInteractions, MeshSeconds, 0);
+
+			// The coefficient only matters to the short range walk
+			if (!bShortRange)
+				break;
+		}
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	if (!FFileHelper::SaveStringArrayToFile(Lines, *OutputPath))
+	{
+		UE_LOG(LogNBodyAccuracy, Error, TEXT("Failed to write results to %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogNBodyAccuracy, Display, TEXT("Results written to %s"), *OutputPath);
+	return 0;
+}
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Game/NBodyBenchmarkCommandlet.h"
+#include "NBodyBenchmarkUtils.h"
+#include "Game/NBodySimulationSubsystem.h"
+#include "Engine/Engine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogNBodyBenchmark, Log, All);
+
+namespace NBodyBenchmark
+{
+	// Same body masses as the game mode defaults
+	constexpr float MinBodyMass = 30;
+	constexpr float MaxBodyMass = 130;
+
+	// Fixed step, the benchmark measures wall time per step rather than simulated time
+	constexpr float StepDeltaTime = 1.f / 60.f;
+}
+
+UNBodyBenchmarkCommandlet::UNBodyBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UNBodyBenchmarkCommandlet::Main(const FString& Params)
+{
+	using namespace NBodyBenchmark;
+	using namespace NBodyBenchmarkUtils;
+
+	const TArray<int> BodyCounts = ParseList<int>(Params, TEXT("Bodies="), {1000, 10000, 100000});
+	const TArray<float> Coefficients = ParseList<float>(Params, TEXT("Coefficients="), {1.2f});
+	const TArray<int> WorkerCounts = ParseList<int>(
+		Params, TEXT("Workers="), {FTaskGraphInterface::Get().GetNumBackgroundThreads() + 1});
+
+	int NumSteps = 100;
+	int NumWarmupSteps = 10;
+	int32 Seed = 1234;
+	float WorldSize = 4096;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("NBodyBenchmark.csv");
+	FParse::Value(*Params, TEXT("Steps="), NumSteps);
+	FParse::Value(*Params, TEXT("WarmupSteps="), NumWarmupSteps);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("WorldSize="), WorldSize);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	EBodyDistribution Distribution = EBodyDistribution::Uniform;
+	FString DistributionName;
+	if (FParse::Value(*Params, TEXT("Distribution="), DistributionName) &&
+		!FBodyDistribution::FromString(DistributionName, Distribution))
+	{
+		UE_LOG(LogNBodyBenchmark, Error, TEXT("Unknown distribution %s"), *DistributionName);
+		return 1;
+	}
+
+	// Barnes Hut by default, Auto may time any mix of solvers depending on the body count & calibration
+	ENBodySolver Solver = ENBodySolver::BarnesHut;
+	FString SolverName;
+	if (FParse::Value(*Params, TEXT("Solver="), SolverName))
+	{
+		const int64 SolverValue = StaticEnum<ENBodySolver>()->GetValueByNameString(SolverName);
+		if (SolverValue == INDEX_NONE)
+		{
+			UE_LOG(LogNBodyBenchmark, Error, TEXT("Unknown solver %s"), *SolverName);
+			return 1;
+		}
+		Solver = StaticCast<ENBodySolver>(SolverValue);
+	}
+
+	if (NumSteps <= 0)
+	{
+		UE_LOG(LogNBodyBenchmark, Error, TEXT("-Steps has to be positive."));
+		return 1;
+	}
+
+	const FQuadrantBounds Bounds(-WorldSize * 0.5f, WorldSize * 0.5f, -WorldSize * 0.5f, WorldSize * 0.5f);
+
+	// The subsystem lives in a world that's never ticked, it only advances when stepped below
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("NBodyBenchmarkWorld"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	UNBodySimulationSubsystem* Subsystem = World->GetSubsystem<UNBodySimulationSubsystem>();
+	check(Subsystem);
+
+	TArray<FString> Lines;
+	Lines.Add(TEXT("Solver,Bodies,Coefficient,Workers,Steps,NsPerBodyStep,StepMs,MinStepMs,BuildMs,ForceMs,")
+		TEXT("IntegrateMs,PackMs"));
+
+	for (const int NumBodies : BodyCounts)
+	{
+		for (const float Coefficient : Coefficients)
+		{
+			for (const int NumWorkers : WorkerCounts)
+			{
+				Subsystem->InitializeDefaults(nullptr, NumBodies, Coefficient, MinBodyMass, MaxBodyMass, false,
+				                             Solver);
+				Subsystem->StartHeadless(Bounds, Seed, NumWorkers, Distribution);
+
+				for (int Step = 0; Step < NumWarmupSteps; Step++)
+					Subsystem->StepSimulation(StepDeltaTime);
+
+				FSimulationStepTimings Total;
+				double MinStepSeconds = TNumericLimits<double>::Max();
+				// Every solver the timed steps ran, in order of first use
+				TArray<ENBodySolver, TInlineAllocator<2>> StepSolvers;
+				for (int Step = 0; Step < NumSteps; Step++)
+				{
+					Subsystem->StepSimulation(StepDeltaTime);
+
+					const FSimulationStepTimings& Timings = Subsystem->GetLastStepTimings();
+					Total.BuildSeconds += Timings.BuildSeconds;
+					Total.ForceSeconds += Timings.ForceSeconds;
+					Total.IntegrateSeconds += Timings.IntegrateSeconds;
+					Total.PackSeconds += Timings.PackSeconds;
+					Total.StepSeconds += Timings.StepSeconds;
+					MinStepSeconds = FMath::Min(MinStepSeconds, Timings.StepSeconds);
+					StepSolvers.AddUnique(Subsystem->GetStepSolver());
+				}
+
+				const double ToMs = 1000.0 / NumSteps;
+				const double NsPerBodyStep = Total.StepSeconds * 1e9 / (StaticCast<double>(NumSteps) * NumBodies);
+				const FString SolverNames = FString::JoinBy(StepSolvers, TEXT("|"), [](const ENBodySolver StepSolver)
+				{
+					return StaticEnum<ENBodySolver>()->GetNameStringByValue(StaticCast<int64>(StepSolver));
+				});
+				const FString Line = FString::Printf(TEXT("%s,%d,%f,%d,%d,%f,%f,%f,%f,%f,%f,%f"),
+					*SolverNames, NumBodies, Coefficient, NumWorkers, NumSteps, NsPerBodyStep, Total.StepSeconds * ToMs,
+					MinStepSeconds * 1000, Total.BuildSeconds * ToMs, Total.ForceSeconds * ToMs,
+					Total.IntegrateSeconds * ToMs, Total.PackSeconds * ToMs);
+
+				UE_LOG(LogNBodyBenchmark, Display, TEXT("%s"), *Line);
+				Lines.Add(Line);
+			}
+		}
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	if (!FFileHelper::SaveStringArrayToFile(Lines, *OutputPath))
+	{
+		UE_LOG(LogNBodyBenchmark, Error, TEXT("Failed to write results to %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogNBodyBenchmark, Display, TEXT("Results written to %s"), *OutputPath);
+	return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Parse.h"
+
+/**
+ * @brief Helpers shared by the benchmark commandlets.
+ */
+namespace NBodyBenchmarkUtils
+{
+	/**
+	 * @brief Parses a comma separated list switch, e.g. -Bodies=1000,10000.
+	 */
+	template<typename ValueType>
+	TArray<ValueType> ParseList(const FString& Params, const TCHAR* Switch, const TArray<ValueType>& Defaults)
+	{
+		FString ListString;
+		if (!FParse::Value(*Params, Switch, ListString))
+			return Defaults;
+
+		TArray<FString> Entries;
+		ListString.ParseIntoArray(Entries, TEXT(","));
+
+		TArray<ValueType> Values;
+		for (const FString& Entry : Entries)
+		{
+			ValueType Value;
+			LexFromString(Value, *Entry);
+			Values.Add(Value);
+		}
+		return Values;
+	}
+}
@@ -0,0 +1,308 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Game/NBodyMicroBenchmarkCommandlet.h"
+#include "NBodyBenchmarkUtils.h"
+#include "Core/DataStructure/BarnesHutTree.h"
+#include "Core/DataStructure/TreeWalker.h"
+#include "Core/Math/BodyDistribution.h"
+#include "Core/Math/ForceKernel.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#if PLATFORM_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+DEFINE_LOG_CATEGORY_STATIC(LogNBodyMicroBenchmark, Log, All);
+
+namespace NBodyMicroBenchmark
+{
+	// Same body masses as the game mode defaults
+	constexpr float MinBodyMass = 30;
+	constexpr float MaxBodyMass = 130;
+
+	// Upper bound on the bodies & lists the force kernel benchmark evaluates, keeps it at a few million interactions
+	constexpr int MaxKernelListSize = 1024;
+	constexpr int MaxKernelBodies = 4096;
+
+	/**
+	 * @brief Counts last level cache misses of the calling thread through perf events.
+	 * Invalid wherever perf events aren't available (non Linux, or perf_event_paranoid forbids it).
+	 */
+	class FCacheMissCounter
+	{
+#if PLATFORM_LINUX
+		int FileDescriptor = -1;
+#endif
+
+	public:
+		FCacheMissCounter()
+		{
+#if PLATFORM_LINUX
+			perf_event_attr Attributes;
+			FMemory::Memzero(Attributes);
+			Attributes.type = PERF_TYPE_HARDWARE;
+			Attributes.size = sizeof(perf_event_attr);
+			Attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+			Attributes.disabled = 1;
+			Attributes.exclude_kernel = 1;
+			Attributes.exclude_hv = 1;
+
+			// This thread only, on any CPU
+			FileDescriptor = syscall(__NR_perf_event_open, &Attributes, 0, -1, -1, 0);
+#endif
+		}
+
+		~FCacheMissCounter()
+		{
+#if PLATFORM_LINUX
+			if (FileDescriptor >= 0)
+				close(FileDescriptor);
+#endif
+		}
+
+		FCacheMissCounter(const FCacheMissCounter&) = delete;
+		FCacheMissCounter& operator=(const FCacheMissCounter&) = delete;
+
+		bool IsValid() const
+		{
+#if PLATFORM_LINUX
+			return FileDescriptor >= 0;
+#else
+			return false;
+#endif
+		}
+
+		void Start()
+		{
+#if PLATFORM_LINUX
+			if (!IsValid())
+				return;
+
+			ioctl(FileDescriptor, PERF_EVENT_IOC_RESET, 0);
+			ioctl(FileDescriptor, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+		}
+
+		/**
+		 * @return Cache misses since Start, 0 if the counter is invalid
+		 */
+		uint64 Stop()
+		{
+			uint64 Count = 0;
+#if PLATFORM_LINUX
+			if (!IsValid())
+				return 0;
+
+			ioctl(FileDescriptor, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(FileDescriptor, &Count, sizeof(Count)) != sizeof(Count))
+				Count = 0;
+#endif
+			return Count;
+		}
+	};
+
+	struct FBenchmarkContext
+	{
+		FString Distribution;
+		int Size = 0;
+		int NumIterations = 0;
+		TArray<FString>& Lines;
+		FCacheMissCounter& CacheMisses;
+	};
+
+	// Written at the end of every benchmark so results can't be optimized away
+	volatile float Sink = 0;
+
+	/**
+	 * @brief Times NumIterations runs of Body, reporting the fastest one.
+	 * @param Name Name of the benchmark in the results
+	 * @param NumItems Number of items a single run of Body processes
+	 * @param Body Called as Body(int Iteration), returns a value to sink
+	 */
+	template<typename BodyType>
+	void Run(FBenchmarkContext& Context, const TCHAR* Name, const int64 NumItems, BodyType&& Body)
+	{
+		// Warm the caches & any lazy allocation up first
+		float Result = Body(0);
+
+		double MinSeconds = TNumericLimits<double>::Max();
+		uint64 TotalCacheMisses = 0;
+		for (int Iteration = 0; Iteration < Context.NumIterations; Iteration++)
+		{
+			Context.CacheMisses.Start();
+			const double StartTime = FPlatformTime::Seconds();
+			Result += Body(Iteration + 1);
+			const double Seconds = FPlatformTime::Seconds() - StartTime;
+			TotalCacheMisses += Context.CacheMisses.Stop();
+
+			MinSeconds = FMath::Min(MinSeconds, Seconds);
+		}
+		Sink = Result;
+
+		const double NsPerItem = MinSeconds * 1e9 / NumItems;
+		const double CacheMissesPerItem = Context.CacheMisses.IsValid()
+			                                  ? StaticCast<double>(TotalCacheMisses) / (NumItems * Context.NumIterations)
+			                                  : -1;
+
+		const FString Line = FString::Printf(TEXT("%s,%s,%d,%d,%lld,%f,%f,%f"), Name, *Context.Distribution,
+			Context.Size, Context.NumIterations, NumItems, NsPerItem, 1e9 / NsPerItem, CacheMissesPerItem);
+		UE_LOG(LogNBodyMicroBenchmark, Display, TEXT("%s"), *Line);
+		Context.Lines.Add(Line);
+	}
+}
+
+UNBodyMicroBenchmarkCommandlet::UNBodyMicroBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UNBodyMicroBenchmarkCommandlet::Main(const FString& Params)
+{
+	using namespace NBodyMicroBenchmark;
+	using namespace NBodyBenchmarkUtils;
+
+	const TArray<int> Sizes = ParseList<int>(Params, TEXT("Sizes="), {1000, 10000, 100000});
+	const TArray<FString> DistributionNames = ParseList<FString>(
+		Params, TEXT("Distributions="), {TEXT("Uniform"), TEXT("Clustered"), TEXT("Plummer")});
+
+	int NumIterations = 5;
+	float Coefficient = 1.2f;
+	int32 Seed = 1234;
+	float WorldSize = 4096;
+	FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("NBodyMicroBenchmark.csv");
+	FParse::Value(*Params, TEXT("Iterations="), NumIterations);
+	FParse::Value(*Params, TEXT("Coefficient="), Coefficient);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("WorldSize="), WorldSize);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	NumIterations = FMath::Max(NumIterations, 1);
+	const FQuadrantBounds Bounds(-WorldSize * 0.5f, WorldSize * 0.5f, -WorldSize * 0.5f, WorldSize * 0.5f);
+
+	FCacheMissCounter CacheMisses;
+	if (!CacheMisses.IsValid())
+		UE_LOG(LogNBodyMicroBenchmark, Warning, TEXT("Hardware cache miss counters unavailable, reporting -1."));
+
+	TArray<FString> Lines;
+	Lines.Add(TEXT("Benchmark,Distribution,Size,Iterations,ItemsPerRun,NsPerItem,ItemsPerSecond,CacheMissesPerItem"));
+
+	for (const FString& DistributionName : DistributionNames)
+	{
+		EBodyDistribution Distribution;
+		if (!FBodyDistribution::FromString(DistributionName, Distribution))
+		{
+			UE_LOG(LogNBodyMicroBenchmark, Error, TEXT("Unknown distribution %s"), *DistributionName);
+			return 1;
+		}
+
+		for (const int Size : Sizes)
+		{
+			FBodyArray Bodies;
+			FBodyDistribution::Generate(Distribution, Size, Bounds, MinBodyMass, MaxBodyMass, Seed, Bodies);
+
+			TArray<FBodyDescriptor> BodyDescriptors;
+			BodyDescriptors.Reserve(Size);
+			for (int i = 0; i < Size; i++)
+				BodyDescriptors.Add(Bodies.Get(i));
+
+			FBenchmarkContext Context{FBodyDistribution::ToString(Distribution), Size, NumIterations, Lines, CacheMisses};
+
+			TBarnesHutTree<ETreeBranchSize::QuadTree> Tree(Bounds, Size);
+			Run(Context, TEXT("Tree.ResetInsert"), Size, [&](int)
+			{
+				Tree.Reset(Bounds, Size);
+				for (int i = 0; i < Size; i++)
+					Tree.Insert(BodyDescriptors[i], i);
+				return StaticCast<float>(Tree.NumNodes());
+			});
+
+			Run(Context, TEXT("Bounds.GetQuadrantLocation"), Size, [&](int)
+			{
+				int Sum = 0;
+				for (const FBodyDescriptor& Body : BodyDescriptors)
+					Sum += StaticCast<int>(Bounds.GetQuadrantLocation(Body.Location));
+				return StaticCast<float>(Sum);
+			});
+
+			Run(Context, TEXT("Bounds.GetQuadrantBounds"), Size, [&](int)
+			{
+				float Sum = 0;
+				for (int i = 0; i < Size; i++)
+					Sum += Bounds.GetQuadrantBounds(i & 3).Left;
+				return Sum;
+			});
+
+			// Same visitor as UNBodySimulationSubsystem::CalculateBodyVelocity, one walk per body
+			const TQuadTreeView TreeView = Tree.GetView();
+			Run(Context, TEXT("Tree.Walk"), Size, [&](int)
+			{
+				FVector2f Sum(0);
+				for (int i = 0; i < Size; i++)
+				{
+					const FVector2f Location = Bodies.GetLocation(i);
+					TTreeWalker<ETreeBranchSize::QuadTree>::Walk(TreeView, Location, i, Coefficient,
+						[&Sum, Location](const FVector2f OtherLocation, const float OtherMass)
+						{
+							const FVector2f Dist = OtherLocation - Location;
+							Sum += Dist * (OtherMass / Dist.SquaredLength());
+						});
+				}
+				return Sum.X + Sum.Y;
+			});
+
+			// Alternate between bounds shifted either way so every run has bodies to warp
+			const float WarpOffset = WorldSize * 0.1f;
+			auto GetWarpBounds = [&Bounds, WarpOffset](const int Iteration)
+			{
+				const float Offset = Iteration % 2 == 0 ? WarpOffset : -WarpOffset;
+				return FQuadrantBounds(Bounds.Left + Offset, Bounds.Right + Offset, Bounds.Top + Offset,
+				                       Bounds.Bottom + Offset);
+			};
+
+			Run(Context, TEXT("Body.WarpWithinBounds"), Size, [&](const int Iteration)
+			{
+				const FQuadrantBounds WarpBounds = GetWarpBounds(Iteration);
+				for (FBodyDescriptor& Body : BodyDescriptors)
+					Body.WarpWithinBounds(WarpBounds.Left, WarpBounds.Right, WarpBounds.Top, WarpBounds.Bottom);
+				return BodyDescriptors[0].Location.X;
+			});
+
+			Run(Context, TEXT("BodyArray.WarpWithinBounds"), Size, [&](const int Iteration)
+			{
+				Bodies.WarpWithinBounds(GetWarpBounds(Iteration));
+				return Bodies.X[0];
+			});
+
+			FInteractionList Interactions;
+			const int ListSize = FMath::Min(Size, MaxKernelListSize);
+			const int NumKernelBodies = FMath::Min(Size, MaxKernelBodies);
+			for (int i = 0; i < ListSize; i++)
+				Interactions.Add(Bodies.GetLocation(i) + FVector2f(0.5f), Bodies.Mass[i]);
+
+			Run(Context, TEXT("ForceKernel.Evaluate"), StaticCast<int64>(ListSize) * NumKernelBodies, [&](int)
+			{
+				FVector2f Sum(0);
+				for (int i = 0; i < NumKernelBodies; i++)
+					Sum += FForceKernel::Evaluate(Bodies.GetLocation(i), Interactions);
+				return Sum.X + Sum.Y;
+			});
+		}
+	}
+
+	if (!FFileHelper::SaveStringArrayToFile(Lines, *OutputPath))
+	{
+		UE_LOG(LogNBodyMicroBenchmark, Error, TEXT("Failed to write results to %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogNBodyMicroBenchmark, Display, TEXT("Results written to %s"), *OutputPath);
+	return 0;
+}
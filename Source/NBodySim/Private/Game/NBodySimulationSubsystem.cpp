@@ -2,11 +2,269 @@
 
 
 #include "Game/NBodySimulationSubsystem.h"
+#include "Game/NiagaraDataInterfaceNBodyBodies.h"
 #include "Camera/CameraComponent.h"
+#include "Core/Math/ForceKernel.h"
 #include "DrawDebugHelpers.h"
 #include "NiagaraComponent.h"
 #include "NiagaraDataInterfaceArrayFunctionLibrary.h"
 #include "NiagaraFunctionLibrary.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+CSV_DEFINE_CATEGORY(NBodySim, true);
+
+// Low level memory tracker tags (-llm, stat LLMFULL), one per container family under a common parent
+LLM_DEFINE_TAG(NBodySim);
+LLM_DEFINE_TAG(NBodySim_Bodies, TEXT("Bodies"), TEXT("NBodySim"));
+LLM_DEFINE_TAG(NBodySim_Tree, TEXT("Tree"), TEXT("NBodySim"));
+LLM_DEFINE_TAG(NBodySim_RenderBuffers, TEXT("RenderBuffers"), TEXT("NBodySim"));
+
+/**
+ * @brief Times a simulation phase until the end of the enclosing scope, as a cycle stat (stat NBodySim), a CSV
+ * profiler timing (csvprofile start) & an Insights CPU event, the cycle stat being compiled out of Test & Shipping.
+ */
+#define NBODYSIM_SCOPE_PHASE(Phase) \
+	SCOPE_CYCLE_COUNTER(NBodySim_##Phase); \
+	CSV_SCOPED_TIMING_STAT(NBodySim, Phase); \
+	TRACE_CPUPROFILER_EVENT_SCOPE(NBodySim_##Phase)
+
+#pragma region Simulation CVars
+/**
+ * @brief Selects how the Barnes Hut tree is built every tick
+ */
+static TAutoConsoleVariable<int32> CVarTreeBuildMode(
+	TEXT("NBodySim.Tree.BuildMode"),
+	1,
+	TEXT("0: Insert every body serially on the game thread\n")
+	TEXT("1: Build one subtree per top level cell in parallel & stitch them under the root\n")
+	TEXT("2: Insert every body concurrently into the same tree, then compute masses bottom-up in parallel")
+);
+
+/**
+ * @brief Refit the tree to the bodies' new locations instead of rebuilding it every tick
+ */
+static TAutoConsoleVariable<bool> CVarIncrementalRefit(
+	TEXT("NBodySim.Tree.bIncrementalRefit"),
+	false,
+	TEXT("If true, only bodies that left their leaf are re-inserted & masses are recomputed bottom-up, the tree is ")
+	TEXT("rebuilt once too many bodies were re-inserted (see NBodySim.Tree.RefitRebuildFraction). ")
+	TEXT("NBodySim.Tree.Backend 0 only")
+);
+
+/**
+ * @brief How far the refit tree may drift before it's rebuilt
+ */
+static TAutoConsoleVariable<float> CVarRefitRebuildFraction(
+	TEXT("NBodySim.Tree.RefitRebuildFraction"),
+	0.25f,
+	TEXT("Fraction of the bodies that may be re-inserted by refits before the tree is rebuilt from scratch. ")
+	TEXT("Re-inserted bodies leave emptied nodes behind, which the walks still have to step over")
+);
+
+/**
+ * @brief Selects which tree implementation the force pass walks
+ */
+static TAutoConsoleVariable<int32> CVarTreeBackend(
+	TEXT("NBodySim.Tree.Backend"),
+	0,
+	TEXT("0: Pointer based Barnes Hut tree built by insertion (see NBodySim.Tree.BuildMode)\n")
+	TEXT("1: Linear quad tree built from radix sorted Morton keys")
+);
+
+/**
+ * @brief Gather every accepted node into a list first & evaluate the list with the SIMD kernel
+ */
+static TAutoConsoleVariable<bool> CVarUseInteractionLists(
+	TEXT("NBodySim.Force.bUseInteractionLists"),
+	true,
+	TEXT("If true, the force pass gathers interaction lists and evaluates them with the SIMD kernel, ")
+	TEXT("otherwise forces are accumulated during the tree walk")
+);
+
+/**
+ * @brief Selects the force solver, overriding the one passed to InitializeDefaults
+ */
+static TAutoConsoleVariable<int32> CVarSolver(
+	TEXT("NBodySim.Force.Solver"),
+	-1,
+	TEXT("-1: Whichever solver the simulation was initialized with\n")
+	TEXT("0: Automatic, direct or Barnes Hut, whichever is faster for the current body count on this host ")
+	TEXT("(see NBodySim.Force.DirectCrossover)\n")
+	TEXT("1: Always walk the Barnes Hut tree\n")
+	TEXT("2: Always evaluate every body pair directly\n")
+	TEXT("3: Fast multipole method (see NBodySim.FMM.Order)\n")
+	TEXT("4: Particle mesh, FFT on a grid over the world bounds (see NBodySim.PM.GridSize)")
+);
+
+/**
+ * @brief Body count the automatic solver selection switches to the tree at
+ */
+static TAutoConsoleVariable<int32> CVarDirectCrossover(
+	TEXT("NBodySim.Force.DirectCrossover"),
+	0,
+	TEXT("Below this many bodies the automatic solver selection uses the direct solver. ")
+	TEXT("0 measures both solvers while running and derives it for this host")
+);
+
+/**
+ * @brief Number of expansion terms of the fast multipole solver
+ */
+static TAutoConsoleVariable<int32> CVarFastMultipoleOrder(
+	TEXT("NBodySim.FMM.Order"),
+	10,
+	TEXT("Number of terms past the monopole the fast multipole expansions keep, every term roughly halves the error. ")
+	TEXT("Clamped to [1, 32]")
+);
+
+/**
+ * @brief Average number of bodies per leaf box of the fast multipole solver
+ */
+static TAutoConsoleVariable<int32> CVarFastMultipoleLeafSize(
+	TEXT("NBodySim.FMM.LeafSize"),
+	32,
+	TEXT("Average number of bodies per fast multipole leaf box the tree depth is picked for, trades the direct near ")
+	TEXT("field against the expansions")
+);
+
+/**
+ * @brief Number of particle mesh grid nodes along each axis
+ */
+static TAutoConsoleVariable<int32> CVarParticleMeshGridSize(
+	TEXT("NBodySim.PM.GridSize"),
+	256,
+	TEXT("Number of particle mesh grid nodes along each axis of the world bounds, rounded up to a power of two, ")
+	TEXT("forces are only resolved down to a few of its cells. Clamped to [16, 2048]")
+);
+
+/**
+ * @brief Add the short range part of the force over the tree on top of the particle mesh
+ */
+static TAutoConsoleVariable<bool> CVarParticleMeshShortRange(
+	TEXT("NBodySim.PM.bShortRange"),
+	false,
+	TEXT("If true, the grid only carries the long range force & the short range part is summed over the tree ")
+	TEXT("(TreePM), so close encounters are resolved too, at the cost of a tree build & a short walk per body")
+);
+
+/**
+ * @brief Radius the force is split at between grid & tree
+ */
+static TAutoConsoleVariable<float> CVarParticleMeshSplitScale(
+	TEXT("NBodySim.PM.SplitScale"),
+	1.25f,
+	TEXT("Radius the force is split at between the particle mesh & the tree, in grid cells, the tree walk reaches ")
+	TEXT("5 times as far (NBodySim.PM.bShortRange only)")
+);
+
+/**
+ * @brief Evaluate quadrupole moments on top of the monopole of every accepted node
+ */
+static TAutoConsoleVariable<bool> CVarQuadrupoles(
+	TEXT("NBodySim.Tree.bQuadrupoles"),
+	false,
+	TEXT("If true, tree nodes also carry quadrupole moments, which allows a larger accuracy coefficient for the same ")
+	TEXT("error. Moments are only evaluated by the per body walk, so interaction lists & group walks are bypassed")
+);
+
+/**
+ * @brief Maximum number of bodies held by a leaf of the linear tree
+ */
+static TAutoConsoleVariable<int32> CVarLeafCapacity(
+	TEXT("NBodySim.Tree.LeafCapacity"),
+	8,
+	TEXT("Maximum number of bodies a linear tree leaf holds before it's split (NBodySim.Tree.Backend 1 only)")
+);
+
+/**
+ * @brief Walk the tree once per leaf bucket instead of once per body
+ */
+static TAutoConsoleVariable<bool> CVarGroupWalk(
+	TEXT("NBodySim.Force.bGroupWalk"),
+	true,
+	TEXT("If true, bodies sharing a linear tree leaf share one tree walk & interact with each other directly ")
+	TEXT("(NBodySim.Tree.Backend 1 only)")
+);
+
+/**
+ * @brief Run the force pass through the work stealing scheduler instead of one task per cost range
+ */
+static TAutoConsoleVariable<bool> CVarWorkStealing(
+	TEXT("NBodySim.Threading.bWorkStealing"),
+	true,
+	TEXT("If true, the force pass is split in small chunks balanced by work stealing, the game thread works too. ")
+	TEXT("Otherwise bodies are split up front into one task per worker using last tick's costs")
+);
+
+/**
+ * @brief Number of bodies handed out at once by the work stealing scheduler
+ */
+static TAutoConsoleVariable<int32> CVarChunkSize(
+	TEXT("NBodySim.Threading.ChunkSize"),
+	64,
+	TEXT("Number of bodies per work stealing chunk")
+);
+
+/**
+ * @brief Run simulation steps off the game thread, the game thread only picks up finished frames
+ */
+static TAutoConsoleVariable<bool> CVarAsyncSimulation(
+	TEXT("NBodySim.Threading.bAsyncSimulation"),
+	false,
+	TEXT("If true, every simulation step runs as a task while the game thread keeps ticking & rendering the latest ")
+	TEXT("finished frame. Otherwise the game thread runs & waits for a step every tick")
+);
+
+/**
+ * @brief Keep the bodies sorted in Morton order so consecutive bodies walk the same parts of the tree
+ */
+static TAutoConsoleVariable<bool> CVarReorderBodies(
+	TEXT("NBodySim.Bodies.bSpatialReorder"),
+	true,
+	TEXT("If true, the body arrays are sorted along a Morton curve again whenever the bodies drifted out of order ")
+	TEXT("(see NBodySim.Bodies.ReorderDrift). Render data & Blueprints still see bodies in spawn order")
+);
+
+/**
+ * @brief Mean distance bodies move before they're sorted again, in mean distances between neighbouring bodies
+ */
+static TAutoConsoleVariable<float> CVarReorderDrift(
+	TEXT("NBodySim.Bodies.ReorderDrift"),
+	2.f,
+	TEXT("Mean distance the bodies travel before they're sorted again, in mean spacings between bodies. Spawning ")
+	TEXT("more than 5% new bodies triggers a sort as well")
+);
+
+/**
+ * @brief Give every body its own power of two time step, only bodies starting a step get a force evaluation
+ */
+static TAutoConsoleVariable<bool> CVarBlockTimeSteps(
+	TEXT("NBodySim.Step.bBlockTimeSteps"),
+	false,
+	TEXT("If true, bodies step 2^N ticks at once depending on their acceleration (kick-drift-kick), every body drifts ")
+	TEXT("every tick but only the ones starting a step are walked. The tree is refit rather than rebuilt while on")
+);
+
+/**
+ * @brief Deepest block time step level, bodies step at most 2^MaxLevel ticks at once
+ */
+static TAutoConsoleVariable<int32> CVarBlockTimeStepMaxLevel(
+	TEXT("NBodySim.Step.MaxLevel"),
+	4,
+	TEXT("Bodies step at most 2^MaxLevel ticks at once (NBodySim.Step.bBlockTimeSteps only)")
+);
+
+/**
+ * @brief Block time step length factor, lower is more accurate & evaluates more bodies every tick
+ */
+static TAutoConsoleVariable<float> CVarBlockTimeStepAccuracy(
+	TEXT("NBodySim.Step.Accuracy"),
+	0.2f,
+	TEXT("Steps are picked so a body's acceleration moves it at most Accuracy^2 / 2 mean body spacings over a step ")
+	TEXT("(NBodySim.Step.bBlockTimeSteps only)")
+);
+#pragma endregion
 
 #pragma region Debug CVars
 /**
@@ -56,6 +314,66 @@ static FAutoConsoleCommandWithWorldAndArgs CCmdSetSimulateEnabled(
 		})
 );
 
+/**
+ * @brief Print how busy every worker was during the last force pass
+ */
+static FAutoConsoleCommandWithWorld CCmdDumpWorkerStats(
+	TEXT("NBodySim.Threading.DumpWorkerStats"),
+	TEXT("Prints the busy & idle time of every worker during the last work stealing force pass."),
+	FConsoleCommandWithWorldDelegate::CreateLambda(
+		[](const UWorld* World)
+		{
+			UNBodySimulationSubsystem* NBodySubsystem = World->GetSubsystem<UNBodySimulationSubsystem>();
+			NBodySubsystem->WaitForSimulationTask();
+
+			const FWorkStealingScheduler* Scheduler = NBodySubsystem->GetScheduler();
+			if (!Scheduler)
+				return;
+
+			UE_LOG(LogTemp, Display, TEXT("Last force pass: %.3f ms"), Scheduler->GetLastPassSeconds() * 1000);
+
+			const TArrayView<const FWorkerStats> WorkerStats = Scheduler->GetWorkerStats();
+			for (int WorkerIndex = 0; WorkerIndex < WorkerStats.Num(); WorkerIndex++)
+			{
+				const FWorkerStats& Stats = WorkerStats[WorkerIndex];
+				UE_LOG(LogTemp, Display, TEXT("Worker %d: busy %.3f ms, idle %.3f ms, %d chunks (%d stolen)"),
+				       WorkerIndex, Stats.BusySeconds * 1000, Stats.IdleSeconds * 1000, Stats.NumChunks,
+				       Stats.NumStolen);
+			}
+		})
+);
+
+/**
+ * @brief Print the memory held by every simulation container
+ */
+static FAutoConsoleCommandWithWorld CCmdDumpMemory(
+	TEXT("NBodySim.Memory.Dump"),
+	TEXT("Prints the used, allocated & slack memory of every simulation container, and their high water marks."),
+	FConsoleCommandWithWorldDelegate::CreateLambda(
+		[](const UWorld* World)
+		{
+			UNBodySimulationSubsystem* NBodySubsystem = World->GetSubsystem<UNBodySimulationSubsystem>();
+			NBodySubsystem->WaitForSimulationTask();
+
+			const FSimulationMemoryUsage& Usage = NBodySubsystem->GetMemoryUsage();
+			const FSimulationMemoryUsage& Peak = NBodySubsystem->GetPeakMemoryUsage();
+			auto LogFootprint = [](const TCHAR* Name, const FMemoryFootprint& Current, const FMemoryFootprint& Max)
+			{
+				constexpr double BytesPerMiB = 1024 * 1024;
+				UE_LOG(LogTemp, Display,
+				       TEXT("%-14s used %8.2f MiB, allocated %8.2f MiB, slack %8.2f MiB, peak allocated %8.2f MiB"),
+				       Name, Current.UsedBytes / BytesPerMiB, Current.AllocatedBytes / BytesPerMiB,
+				       Current.GetSlackBytes() / BytesPerMiB, Max.AllocatedBytes / BytesPerMiB);
+			};
+
+			UE_LOG(LogTemp, Display, TEXT("Simulated bodies: %d"), NBodySubsystem->NumBodies());
+			LogFootprint(TEXT("Bodies"), Usage.Bodies, Peak.Bodies);
+			LogFootprint(TEXT("Tree"), Usage.Tree, Peak.Tree);
+			LogFootprint(TEXT("RenderBuffers"), Usage.RenderBuffers, Peak.RenderBuffers);
+			LogFootprint(TEXT("Total"), Usage.GetTotal(), Peak.GetTotal());
+		})
+);
+
 /**
  * @brief Print the amount of bodies being simulated
  */
@@ -78,6 +396,7 @@ void UNBodySimulationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 
 void UNBodySimulationSubsystem::Deinitialize()
 {
+	WaitForSimulationTask();
 	Super::Deinitialize();
 	FViewport::ViewportResizedEvent.Remove(ViewportResizedEventDelegate);
 	GetWorld()->GetTimerManager().ClearTimer(ProgramLoadTimerHandle);
@@ -88,14 +407,18 @@ void UNBodySimulationSubsystem::Tick(float DeltaTime)
 	Super::Tick(DeltaTime);
 	if (bShouldSimulate)
 	{
-		SimulateOneTick(DeltaTime);
+		if (CVarAsyncSimulation->GetBool())
+			TickAsyncSimulation(DeltaTime);
+		else
+			SimulateOneTick(DeltaTime);
 	}
 	UpdateRenderer();
 }
 
 void UNBodySimulationSubsystem::InitializeDefaults(const TSubclassOf<ANiagaraActor>& Renderer,
                                                    int NumStartingBodies, float Coefficient, float MinimumBodyMass,
-                                                   float MaximumBodyMass, bool bShouldAutoLoad)
+                                                   float MaximumBodyMass, bool bShouldAutoLoad,
+                                                   ENBodySolver Solver)
 {
 	this->RendererClass = Renderer;
 	this->NumStartBodies = NumStartingBodies;
@@ -103,6 +426,7 @@ void UNBodySimulationSubsystem::InitializeDefaults(const TSubclassOf<ANiagaraAct
 	this->MinBodyMass = MinimumBodyMass;
 	this->MaxBodyMass = MaximumBodyMass;
 	this->bAutoLoad = bShouldAutoLoad;
+	this->DefaultSolver = Solver;
 }
 
 void UNBodySimulationSubsystem::SetShouldSimulate(const bool bEnable)
@@ -112,9 +436,6 @@ void UNBodySimulationSubsystem::SetShouldSimulate(const bool bEnable)
 
 void UNBodySimulationSubsystem::StartSimulation()
 {
-	Bodies.Reserve(NumStartBodies);
-	RenderDataArr.Init(FVector(0), NumStartBodies);
-
 	// Cache the first (and only) camera and initialize the starting screen bounds
 	GameCamera = GetWorld()->GetAutoActivateCameraIterator()->Get();
 	UpdateCameraWorldBounds();
@@ -125,15 +446,62 @@ void UNBodySimulationSubsystem::StartSimulation()
 	RendererActor = GetWorld()->SpawnActor<ANiagaraActor>(RendererClass);
 	NiagaraSystem = StaticCast<UNiagaraComponent*>(RendererActor->GetRootComponent());
 	NiagaraSystem->SetVariableFloat(FName("MaxMass"), MaxBodyMass);
+	bRendersThroughDataInterface = UNiagaraFunctionLibrary::GetDataInterface<UNiagaraDataInterfaceNBodyBodies>(
+		NiagaraSystem, FName("Bodies")) != nullptr;
 
-	QuadTree = MakeUnique<TBarnesHutTree<ETreeBranchSize::QuadTree>>(WorldBounds, NumStartBodies);
-	AddBodies(NumStartBodies);
+	// One worker per background thread, plus the game thread
+	InitializeSimulationState(FMath::Rand(), FTaskGraphInterface::Get().GetNumBackgroundThreads() + 1,
+	                          EBodyDistribution::Uniform);
 
 	SetShouldSimulate(true);
 	GetWorld()->GetTimerManager().SetTimer(ProgramLoadTimerHandle, this, &UNBodySimulationSubsystem::AdjustFrameLoad,
 	                                       0.1f, true, 0.1f);
 }
 
+void UNBodySimulationSubsystem::StartHeadless(const FQuadrantBounds& Bounds, const int32 Seed, const int InNumWorkers,
+                                              const EBodyDistribution Distribution)
+{
+	WaitForSimulationTask();
+
+	WorldBounds = Bounds;
+	InitializeSimulationState(Seed, InNumWorkers, Distribution);
+}
+
+void UNBodySimulationSubsystem::InitializeSimulationState(const int32 Seed, const int InNumWorkers,
+                                                          const EBodyDistribution Distribution)
+{
+	LLM_SCOPE_BYTAG(NBodySim);
+	NumWorkers = FMath::Max(InNumWorkers, 1);
+
+	{
+		LLM_SCOPE_BYTAG(NBodySim_Tree);
+		QuadTree = MakeUnique<TBarnesHutTree<ETreeBranchSize::QuadTree>>(WorldBounds, NumStartBodies);
+		LinearQuadTree = MakeUnique<TLinearQuadTree<ETreeBranchSize::QuadTree>>(WorldBounds, NumStartBodies);
+	}
+
+	Scheduler = MakeUnique<FWorkStealingScheduler>(NumWorkers);
+	WorkerInteractions.SetNum(Scheduler->GetNumWorkers());
+	ChunkCostPrefix.Reset();
+	TotalSimulationCost = 0;
+	SolverCalibration = FSolverCalibration();
+
+	RandomSeed = StaticCast<uint32>(Seed);
+	Bodies.Reset();
+	{
+		LLM_SCOPE_BYTAG(NBodySim_Bodies);
+		FBodyDistribution::Generate(Distribution, NumStartBodies, WorldBounds, MinBodyMass, MaxBodyMass, RandomSeed,
+		                            Bodies);
+		BodyOrder.Reset();
+		BodyOrder.AddBodies(Bodies.Num());
+	}
+
+	MemoryUsage = FSimulationMemoryUsage();
+	PeakMemoryUsage = FSimulationMemoryUsage();
+
+	// Headless runs step without going through a tick, their bounds never change
+	StepBounds = WorldBounds;
+}
+
 void UNBodySimulationSubsystem::AdjustFrameLoad()
 {
 	UE_LOG(LogTemp, Display, TEXT("Num simulated bodies: %d"), NumBodies());
@@ -161,178 +529,740 @@ void UNBodySimulationSubsystem::UpdateStats(const float DeltaTime)
 
 void UNBodySimulationSubsystem::AddBodies(const int NumBodies)
 {
-	for (int i = 0; i < NumBodies; i++)
-	{
-		Bodies.Add(FBodyDescriptor(
-			FVector2f(FMath::RandRange(WorldBounds.Left, WorldBounds.Right),
-			          FMath::RandRange(WorldBounds.Top, WorldBounds.Bottom)),
-			FMath::RandRange(MinBodyMass, MaxBodyMass)
-		));
-	}
+	LLM_SCOPE_BYTAG(NBodySim_Bodies);
+	FBodyDistribution::Generate(EBodyDistribution::Uniform, NumBodies, WorldBounds, MinBodyMass, MaxBodyMass,
+	                            RandomSeed, Bodies);
+	BodyOrder.AddBodies(Bodies.Num());
 }
 
 void UNBodySimulationSubsystem::UpdateRenderer()
 {
-	if (!RendererActor)
+	// The data interface pulls its frames itself
+	if (!RendererActor || bRendersThroughDataInterface)
+		return;
+
+	// Nothing new since the last frame that was pushed
+	if (!RenderBuffers.Update())
 		return;
 
+	LLM_SCOPE_BYTAG(NBodySim_RenderBuffers);
+	const TArrayView<const FVector3f> PackedBodies = RenderBuffers.GetReadBuffer().GetPackedBodies();
+	ArrayRenderData.SetNumUninitialized(PackedBodies.Num());
+	for (int i = 0; i < PackedBodies.Num(); i++)
+	{
+		ArrayRenderData[i] = FVector(PackedBodies[i]);
+	}
+
 	UNiagaraDataInterfaceArrayFunctionLibrary::SetNiagaraArrayVector(NiagaraSystem, FName("ParticleData"),
-	                                                                 RenderDataArr);
+	                                                                 ArrayRenderData);
 }
 
-// @TODO: This needs cleanup
-void UNBodySimulationSubsystem::SimulateOneTick(const float DeltaTime)
+const FBodyRenderFrame& UNBodySimulationSubsystem::AcquireRenderFrame()
 {
-	UpdateStats(DeltaTime);
+	check(IsInGameThread());
+
+	// Taking a newer buffer mid frame could hand it back to the writer while a system read earlier is still simulating
+	if (RenderBuffersReadFrame != GFrameCounter)
+	{
+		RenderBuffersReadFrame = GFrameCounter;
+		RenderBuffers.Update();
+	}
+	return RenderBuffers.GetReadBuffer();
+}
 
+void UNBodySimulationSubsystem::SpawnPendingBodies()
+{
 	// Update bodies count according to auto load result
 	if (NumToSpawnNextTick > 0 && bAutoLoad)
 	{
 		UE_LOG(LogTemp, Display, TEXT("Spawning num bodies: %d"), NumToSpawnNextTick);
 		AddBodies(NumToSpawnNextTick);
-		NiagaraSystem->ResetSystem();
+
+		// The data interface's emitter spawns the new particles on top of the existing ones, arrays need a reset
+		if (NiagaraSystem && !bRendersThroughDataInterface)
+			NiagaraSystem->ResetSystem();
 
 		NumToSpawnNextTick = 0;
 	}
+}
 
-	// Ensure the bodies are actually warped before building the tree,
-	// as this can lead to a crash if they're outside bounds at the time of tree building.
-	for (auto& Body : Bodies)
+// @TODO: This needs cleanup
+void UNBodySimulationSubsystem::SimulateOneTick(const float DeltaTime)
+{
+	// Switching out of async mode, or stepping from the console while a step is still running
+	WaitForSimulationTask();
+
+	UpdateStats(DeltaTime);
+	SpawnPendingBodies();
+	StepBounds = WorldBounds;
+	StepSimulation(DeltaTime);
+
+	TickDebug(DeltaTime);
+}
+
+void UNBodySimulationSubsystem::TickAsyncSimulation(const float DeltaTime)
+{
+	// Still busy with the last step, its frame gets picked up on a later tick
+	if (SimulationTask.IsValid() && !SimulationTask.IsCompleted())
+		return;
+
+	// Nothing touches the bodies or the tree between steps, so this is the only window for game thread work.
+	// Load is adjusted against the step time, the game thread's frame time no longer depends on it.
+	if (SimulationTask.IsValid())
 	{
-		Body.WarpWithinBounds(WorldBounds);
+		UpdateStats(LastStepTimings.StepSeconds);
+		TickDebug(DeltaTime);
 	}
-	
-	// Rerun the tree,
-	BatchAndWaitBuildTree(DeltaTime);
 
-	TickDebug(DeltaTime);
+	SpawnPendingBodies();
+
+	StepBounds = WorldBounds;
+	// Same task system the scheduler's workers run on, whose waits run unstarted tasks instead of blocking
+	SimulationTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, DeltaTime]() { StepSimulation(DeltaTime); });
+}
+
+void UNBodySimulationSubsystem::WaitForSimulationTask()
+{
+	if (SimulationTask.IsValid())
+		SimulationTask.Wait();
+}
+
+void UNBodySimulationSubsystem::StepSimulation(const float DeltaTime)
+{
+	// Anything not tagged more precisely below is force pass & scheduler scratch
+	LLM_SCOPE_BYTAG(NBodySim);
+	const double StepStartTime = FPlatformTime::Seconds();
+
+	ReorderBodies(DeltaTime);
+
+	// Bodies part way through a step when block time steps are switched on would be kicked for a step they never took
+	const bool bBlockTimeSteps = CVarBlockTimeSteps->GetBool();
+	if (bBlockTimeSteps && !bUseBlockTimeSteps)
+		BlockTimeStepper.Reset(Bodies);
+	bUseBlockTimeSteps = bBlockTimeSteps;
+
+	// Rerun the tree, unless another solver replaces the Barnes Hut walk
+	StepSolver = SelectSolver();
+	bTreeIsCurrent = StepSolver == ENBodySolver::BarnesHut ||
+		(StepSolver == ENBodySolver::ParticleMesh && CVarParticleMeshShortRange->GetBool());
+	if (bTreeIsCurrent)
+		BatchAndWaitBuildTree(DeltaTime);
+	else
+		WarpBodies();
 
-	BatchAndWaitBodyCalcTasks(DeltaTime);
+	if (StepSolver == ENBodySolver::BarnesHut && CVarQuadrupoles->GetBool())
+		UpdateQuadrupoles();
+	const double BuildEndTime = FPlatformTime::Seconds();
 
-	for (int i = 0; i < Bodies.Num(); i++)
 	{
-		const FBodyDescriptor& Body = Bodies[i];
-		FVector RenderData;
-		RenderData.X = Body.Location.X;
-		RenderData.Y = Body.Location.Y;
-		RenderData.Z = Body.Mass;
-
-		if (i < RenderDataArr.Num())
-			RenderDataArr[i] = RenderData;
+		NBODYSIM_SCOPE_PHASE(ForcePass);
+
+		// Solvers other than the per body walk evaluate every body anyway, only the active ones keep their kick
+		if (bUseBlockTimeSteps)
+		{
+			BlockTimeStepper.SetMaxLevel(CVarBlockTimeStepMaxLevel->GetInt());
+			BlockTimeStepper.SetAccuracy(CVarBlockTimeStepAccuracy->GetFloat());
+			const TArrayView<const uint32> SpatialOrder =
+				bTreeIsCurrent ? GetSpatialBodyOrder() : TArrayView<const uint32>();
+			BlockTimeStepper.GatherActiveBodies(Bodies, SpatialOrder);
+			BlockTimeStepper.BeginForcePass(Bodies);
+		}
+
+		if (StepSolver == ENBodySolver::Direct)
+			BatchAndWaitDirectCalcTasks(DeltaTime);
+		else if (StepSolver == ENBodySolver::FastMultipole)
+			BatchAndWaitFastMultipoleCalcTasks(DeltaTime);
+		else if (StepSolver == ENBodySolver::ParticleMesh)
+			BatchAndWaitParticleMeshCalcTasks(DeltaTime);
+		// Buckets only exist in the linear tree, the insertion tree always holds one body per leaf
+		else if (bUseLinearTree && CVarGroupWalk->GetBool() && !bHasQuadrupoles)
+			BatchAndWaitBucketCalcTasks(DeltaTime);
 		else
-			RenderDataArr.Add(RenderData);
+			BatchAndWaitBodyCalcTasks(DeltaTime);
+
+		if (bUseBlockTimeSteps)
+		{
+			// Side of the square every body would get if they were spread evenly
+			const float MeanSpacing = FMath::Sqrt(StepBounds.HorizontalSize() * StepBounds.VerticalSize() /
+				FMath::Max(Bodies.Num(), 1));
+			BlockTimeStepper.EndForcePass(Bodies, DeltaTime, MeanSpacing);
+		}
+	}
+	const double ForceEndTime = FPlatformTime::Seconds();
+
+	{
+		NBODYSIM_SCOPE_PHASE(Integrate);
+
+		// The tree holds its own copies of the bodies, so integrating after the force pass is equivalent to doing it
+		// per body inside the tasks, and lets the whole pass stream through the location & velocity arrays.
+		Bodies.Integrate(DeltaTime);
 	}
+	const double IntegrateEndTime = FPlatformTime::Seconds();
+
+	{
+		NBODYSIM_SCOPE_PHASE(RenderPacking);
+		LLM_SCOPE_BYTAG(NBodySim_RenderBuffers);
+
+		// Particles are laid out in spawn order, so every body keeps feeding the same particle once reordered
+		const TArrayView<const uint32> StableIndices = BodyOrder.IsIdentity()
+			                                               ? TArrayView<const uint32>()
+			                                               : BodyOrder.GetStableIndices();
+
+		// Pack into whichever buffer the game thread isn't reading & hand it over
+		RenderBuffers.GetWriteBuffer().Pack(Bodies, StableIndices);
+		RenderBuffers.Publish();
+	}
+
+	UpdateSimulationCounters();
+	UpdateMemoryStats();
+
+	const double StepEndTime = FPlatformTime::Seconds();
+	LastStepTimings.BuildSeconds = BuildEndTime - StepStartTime;
+	LastStepTimings.ForceSeconds = ForceEndTime - BuildEndTime;
+	LastStepTimings.IntegrateSeconds = IntegrateEndTime - ForceEndTime;
+	LastStepTimings.PackSeconds = StepEndTime - IntegrateEndTime;
+	LastStepTimings.StepSeconds = StepEndTime - StepStartTime;
+
+	UpdateSolverCalibration();
 }
 
 void UNBodySimulationSubsystem::BatchAndWaitBodyCalcTasks(float DeltaTime)
 {
-	TFunction<void (int Start, int End)> Func = TFunction<void (int, int)>(
-		[DeltaTime,this](int StartIndex, int EndIndex)
+	const TQuadTreeView Tree = GetTreeView();
+	// Interaction lists only hold monopoles
+	const bool bUseInteractionLists = CVarUseInteractionLists->GetBool() && !Tree.Quadrupoles;
+
+	// Hand bodies out in the tree's spatial order when it has one, so every worker gets a compact region of space and
+	// keeps walking the same upper tree nodes. With block time steps only the active bodies are walked, in that order.
+	const TArrayView<const uint32> SpatialOrder =
+		bUseBlockTimeSteps ? BlockTimeStepper.GetActiveBodies() : GetSpatialBodyOrder();
+	const int NumWalkedBodies = bUseBlockTimeSteps ? SpatialOrder.Num() : Bodies.Num();
+	const bool bHasSpatialOrder = SpatialOrder.Num() == NumWalkedBodies;
+	auto GetBodyIndex = [SpatialOrder, bHasSpatialOrder](const int OrderIndex) -> uint32
+	{
+		return bHasSpatialOrder ? SpatialOrder[OrderIndex] : OrderIndex;
+	};
+
+	// Returns the summed walk stats of the handled bodies, their accepted nodes being their cost
+	auto Func = [DeltaTime, this, &Tree, bUseInteractionLists, &GetBodyIndex](int StartIndex, int EndIndex,
+	                                                                          FInteractionList& Interactions)
+	{
+		FTreeWalkStats WalkStats;
+		for (int OrderIndex = StartIndex; OrderIndex < EndIndex; OrderIndex++)
 		{
-			for (int i = StartIndex; i < EndIndex; i++)
+			const uint32 i = GetBodyIndex(OrderIndex);
+			FBodyDescriptor Body = Bodies.Get(i);
+
+			// Reset calc cost for next frame
+			Body.SimCost = 0;
+			if (bUseInteractionLists)
 			{
-				FBodyDescriptor& Body = Bodies[i];
+				Interactions.Reset();
+				WalkStats += this->GatherInteractions(Body, i, Tree, Interactions);
 
-				// Reset calc cost for next frame
-				Body.SimCost = 0;
-				this->CalculateBodyVelocity(DeltaTime, Body, *QuadTree);
-				Body.Location += Body.Velocity * DeltaTime;
-				TotalSimulationCost += Body.SimCost;
+				Body.Velocity += FForceKernel::Evaluate(Body.Location, Interactions);
+				Body.SimCost = Interactions.Num();
+			}
+			else
+			{
+				WalkStats += this->CalculateBodyVelocity(DeltaTime, Body, i, Tree);
 			}
-		});
 
-	const int NumThreads = FTaskGraphInterface::Get().GetNumBackgroundThreads();
+			Bodies.SetVelocity(i, Body.Velocity);
+			Bodies.Cost[i] = Body.SimCost;
+		}
+		return WalkStats;
+	};
 
-	const int SimulationCostPerThread = TotalSimulationCost / NumThreads;
-	// Reset total cost to be updated in the next run
-	TotalSimulationCost = 0;
+	// Costzones, slices of equal last tick cost along the spatial order
+	const int ChunkSize = FMath::Max(CVarChunkSize->GetInt(), 1);
+	FWorkStealingScheduler::BuildChunkCostPrefix(NumWalkedBodies, ChunkSize,
+		[this, &GetBodyIndex](const int OrderIndex) { return Bodies.Cost[GetBodyIndex(OrderIndex)]; },
+		ChunkCostPrefix);
 
-	// Initialize the tasks and run them
-	int CurrentCostStep = 0;
-	int StartIndex = 0;
-	int EndIndex = 0;
-	int TaskIndex = 0;
+	// Every worker or task accumulates its own cost, summed once they're all done
+	TArray<FTreeWalkStats> WorkerWalkStats;
 
-	TArray<TFuture<void>> TaskFutures;
-	for (FBodyDescriptor& Body : Bodies)
+	if (CVarWorkStealing->GetBool())
+	{
+		WorkerWalkStats.SetNum(Scheduler->GetNumWorkers());
+		Scheduler->ParallelForWeighted(NumWalkedBodies, ChunkSize, ChunkCostPrefix,
+			[this, &Func, &WorkerWalkStats](const int StartIndex, const int EndIndex, const int WorkerIndex)
+			{
+				// Owned by this worker, reused for every chunk it runs
+				WorkerWalkStats[WorkerIndex] += Func(StartIndex, EndIndex, WorkerInteractions[WorkerIndex]);
+			});
+		UpdateWorkerStats();
+	}
+	else
 	{
-		CurrentCostStep += Body.SimCost;
-		++EndIndex;
+		// One task per worker, each owning one slice, the calling thread runs the first
+		const int NumTasks = NumWorkers;
+		const int NumChunks = ChunkCostPrefix.Num() - 1;
+		const double TotalCost = ChunkCostPrefix.Last();
+		WorkerWalkStats.SetNum(NumTasks);
 
-		// Edge cases, should be cleaned up into something better
-		const bool bIsLastTask = TaskIndex == NumThreads - 1;
-		const bool bIsLastBody = &Body == &Bodies.Last();
-		if (bIsLastBody || bIsLastTask)
+		auto RunSlice = [&Func, &WorkerWalkStats](const int StartIndex, const int EndIndex, const int TaskIndex)
 		{
-			TaskFutures.Add(
-				Async(EAsyncExecution::ThreadPool, [=]() { Func(StartIndex, Bodies.Num()); })
-			);
-			break;
-		}
-		if (CurrentCostStep > SimulationCostPerThread)
+			TRACE_CPUPROFILER_EVENT_SCOPE(NBodySim_ForcePassTask);
+
+			// Owned by this task, reused for every body it handles
+			FInteractionList Interactions;
+			WorkerWalkStats[TaskIndex] = Func(StartIndex, EndIndex, Interactions);
+		};
+
+		TArray<UE::Tasks::FTask> Tasks;
+		int FirstSliceEnd = 0;
+		int StartChunk = 0;
+		for (int TaskIndex = 0; TaskIndex < NumTasks; TaskIndex++)
 		{
-			TaskFutures.Add(
-				Async(EAsyncExecution::ThreadPool, [=]() { Func(StartIndex, EndIndex); })
-			);
+			int EndChunk = NumChunks;
+			if (TaskIndex < NumTasks - 1)
+			{
+				EndChunk = TotalCost > 0
+					           ? Algo::LowerBound(ChunkCostPrefix, TotalCost * (TaskIndex + 1) / NumTasks)
+					           : NumChunks * (TaskIndex + 1) / NumTasks;
+				EndChunk = FMath::Clamp(EndChunk, StartChunk, NumChunks);
+			}
+
+			const int StartIndex = StartChunk * ChunkSize;
+			const int EndIndex = FMath::Min(NumWalkedBodies, EndChunk * ChunkSize);
+			StartChunk = EndChunk;
+			if (TaskIndex == 0)
+			{
+				FirstSliceEnd = EndIndex;
+				continue;
+			}
+			if (StartIndex >= EndIndex)
+				continue;
 
-			StartIndex = EndIndex;
-			CurrentCostStep = 0;
-			++TaskIndex;
+			Tasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [&RunSlice, StartIndex, EndIndex, TaskIndex]()
+			{
+				RunSlice(StartIndex, EndIndex, TaskIndex);
+			}));
 		}
+
+		if (FirstSliceEnd > 0)
+			RunSlice(0, FirstSliceEnd, 0);
+
+		// Waiting on a task that hasn't started yet retracts it & runs it here, rather than blocking on busy workers
+		for (UE::Tasks::FTask& Task : Tasks)
+			Task.Wait();
+	}
+
+	FTreeWalkStats TotalWalkStats;
+	for (const FTreeWalkStats& WalkStats : WorkerWalkStats)
+		TotalWalkStats += WalkStats;
+
+	TotalSimulationCost = TotalWalkStats.NumAccepted;
+	TotalOpenedCells = TotalWalkStats.NumOpened;
+}
+
+void UNBodySimulationSubsystem::BatchAndWaitBucketCalcTasks(float DeltaTime)
+{
+	const TQuadTreeView Tree = GetTreeView();
+	const TArrayView<const uint32> Buckets = LinearQuadTree->GetLeafNodeIndices();
+
+	// Buckets vary a lot in cost, hand them out in chunks of roughly NBodySim.Threading.ChunkSize bodies
+	const int ChunkSize = FMath::Max(CVarChunkSize->GetInt() / FMath::Max(CVarLeafCapacity->GetInt(), 1), 1);
+
+	// Buckets are already in Morton order, every body of a bucket has the same cost
+	FWorkStealingScheduler::BuildChunkCostPrefix(Buckets.Num(), ChunkSize, [&Tree, &Buckets, this](const int i)
+	{
+		const TQuadTreeNode& Bucket = Tree.GetNode(Buckets[i]);
+		return Bodies.Cost[Tree.LeafBodyIndices[Bucket.FirstBody]] * Bucket.NumBodies;
+	}, ChunkCostPrefix);
+
+	TArray<FTreeWalkStats> WorkerWalkStats;
+	WorkerWalkStats.SetNum(Scheduler->GetNumWorkers());
+
+	Scheduler->ParallelForWeighted(Buckets.Num(), ChunkSize, ChunkCostPrefix,
+		[&](const int StartIndex, const int EndIndex, const int WorkerIndex)
+		{
+			for (int i = StartIndex; i < EndIndex; i++)
+				WorkerWalkStats[WorkerIndex] += CalculateBucketVelocities(Buckets[i], Tree,
+				                                                          WorkerInteractions[WorkerIndex]);
+		});
+	UpdateWorkerStats();
+
+	FTreeWalkStats TotalWalkStats;
+	for (const FTreeWalkStats& WalkStats : WorkerWalkStats)
+		TotalWalkStats += WalkStats;
+
+	TotalSimulationCost = TotalWalkStats.NumAccepted;
+	TotalOpenedCells = TotalWalkStats.NumOpened;
+}
+
+void UNBodySimulationSubsystem::BatchAndWaitDirectCalcTasks(float DeltaTime)
+{
+	DirectSolver.Solve(Bodies, *Scheduler);
+	UpdateWorkerStats();
+
+	const int64 NumPairs = StaticCast<int64>(Bodies.Num()) * (Bodies.Num() - 1);
+	TotalSimulationCost = StaticCast<int>(FMath::Min<int64>(NumPairs, MAX_int32));
+	TotalOpenedCells = 0;
+}
+
+void UNBodySimulationSubsystem::BatchAndWaitFastMultipoleCalcTasks(float DeltaTime)
+{
+	LLM_SCOPE_BYTAG(NBodySim_Tree);
+
+	FastMultipoleSolver.SetOrder(CVarFastMultipoleOrder->GetInt());
+	FastMultipoleSolver.SetLeafSize(CVarFastMultipoleLeafSize->GetInt());
+	const int64 NumDirectInteractions = FastMultipoleSolver.Solve(Bodies, StepBounds);
+
+	TotalSimulationCost = StaticCast<int>(FMath::Min<int64>(NumDirectInteractions, MAX_int32));
+	TotalOpenedCells = 0;
+}
+
+void UNBodySimulationSubsystem::BatchAndWaitParticleMeshCalcTasks(float DeltaTime)
+{
+	LLM_SCOPE_BYTAG(NBodySim_Tree);
+
+	ParticleMeshSolver.SetGridSize(CVarParticleMeshGridSize->GetInt());
+	ParticleMeshSolver.SetSplitScale(CVarParticleMeshSplitScale->GetFloat());
+
+	const TQuadTreeView Tree = bTreeIsCurrent ? GetTreeView() : TQuadTreeView();
+	const int64 NumShortRangeInteractions = ParticleMeshSolver.Solve(Bodies, StepBounds, NumWorkers,
+		bTreeIsCurrent ? &Tree : nullptr, AccuracyCoefficient);
+
+	TotalSimulationCost = StaticCast<int>(FMath::Min<int64>(NumShortRangeInteractions, MAX_int32));
+	TotalOpenedCells = 0;
+}
+
+ENBodySolver UNBodySimulationSubsystem::SelectSolver()
+{
+	ENBodySolver Solver = DefaultSolver;
+	const int32 SolverOverride = CVarSolver->GetInt();
+	if (SolverOverride >= 0 && SolverOverride <= StaticCast<int32>(ENBodySolver::ParticleMesh))
+		Solver = StaticCast<ENBodySolver>(SolverOverride);
+	if (Solver != ENBodySolver::Auto)
+		return Solver;
+
+	const int N = Bodies.Num();
+	if (CVarDirectCrossover->GetInt() > 0)
+		return N < CVarDirectCrossover->GetInt() ? ENBodySolver::Direct : ENBodySolver::BarnesHut;
+
+	if (N > FSolverCalibration::MaxDirectBodies)
+		return ENBodySolver::BarnesHut;
+
+	// Measure each solver once before predicting anything
+	if (SolverCalibration.DirectSecondsPerPair == 0)
+		return ENBodySolver::Direct;
+	if (SolverCalibration.TreeSecondsPerBodyLog == 0)
+		return ENBodySolver::BarnesHut;
+
+	const double DirectSeconds = SolverCalibration.PredictDirectSeconds(N);
+	const double TreeSeconds = SolverCalibration.PredictTreeSeconds(N);
+	const ENBodySolver FasterSolver = DirectSeconds < TreeSeconds ? ENBodySolver::Direct : ENBodySolver::BarnesHut;
+
+	// Both models drift with the body distribution, accuracy coefficient & machine load, so the slower solver is
+	// measured again now & then, as long as it's close enough for the step not to hitch
+	if (++SolverCalibration.StepsSinceProbe >= FSolverCalibration::ProbeInterval &&
+		FMath::Max(DirectSeconds, TreeSeconds) < FMath::Min(DirectSeconds, TreeSeconds) * FSolverCalibration::ProbeMargin)
+	{
+		SolverCalibration.StepsSinceProbe = 0;
+		return FasterSolver == ENBodySolver::Direct ? ENBodySolver::BarnesHut : ENBodySolver::Direct;
+	}
+
+	return FasterSolver;
+}
+
+void UNBodySimulationSubsystem::UpdateSolverCalibration()
+{
+	// The cost models only cover the two solvers the automatic selection picks between
+	const int N = Bodies.Num();
+	if (N < 2 || (StepSolver != ENBodySolver::Direct && StepSolver != ENBodySolver::BarnesHut))
+		return;
+
+	auto Smooth = [](double& Estimate, const double Sample)
+	{
+		Estimate = Estimate == 0 ? Sample : FMath::Lerp(Estimate, Sample, FSolverCalibration::SmoothingFactor);
+	};
+
+	// Both include the warp, so the two are compared on the same footing
+	const double Seconds = LastStepTimings.BuildSeconds + LastStepTimings.ForceSeconds;
+	if (StepSolver == ENBodySolver::Direct)
+		Smooth(SolverCalibration.DirectSecondsPerPair, Seconds / (0.5 * N * (N - 1)));
+	else
+		Smooth(SolverCalibration.TreeSecondsPerBodyLog, Seconds / (N * FMath::Log2(StaticCast<double>(N))));
+
+	if (!SolverCalibration.IsCalibrated())
+		return;
+
+	// Solve DirectSecondsPerPair * (N - 1) / 2 = TreeSecondsPerBodyLog * log2(N) by fixed point iteration, the log
+	// barely moves so it settles within a few iterations
+	const double Ratio = SolverCalibration.TreeSecondsPerBodyLog / SolverCalibration.DirectSecondsPerPair;
+	double Crossover = 1024;
+	for (int Iteration = 0; Iteration < 8; Iteration++)
+		Crossover = 1 + 2 * Ratio * FMath::Log2(FMath::Max(Crossover, 2.0));
+
+	SolverCalibration.Crossover = FMath::Clamp(FMath::CeilToInt(Crossover), 2, MAX_int32);
+	SET_DWORD_STAT(NBodySim_DirectCrossover, SolverCalibration.Crossover);
+	CSV_CUSTOM_STAT(NBodySim, DirectCrossover, SolverCalibration.Crossover, ECsvCustomStatOp::Set);
+}
+
+void UNBodySimulationSubsystem::UpdateWorkerStats()
+{
+	const TArrayView<const FWorkerStats> WorkerStats = Scheduler->GetWorkerStats();
+	const double PassSeconds = Scheduler->GetLastPassSeconds();
+	if (WorkerStats.Num() == 0 || PassSeconds <= 0)
+		return;
+
+	double IdleSeconds = 0;
+	for (const FWorkerStats& Stats : WorkerStats)
+		IdleSeconds += Stats.IdleSeconds;
+
+	const float IdlePercentage = 100 * IdleSeconds / (PassSeconds * WorkerStats.Num());
+	SET_FLOAT_STAT(NBodySim_WorkerIdlePercentage, IdlePercentage);
+	CSV_CUSTOM_STAT(NBodySim, WorkerIdlePercentage, IdlePercentage, ECsvCustomStatOp::Set);
+}
+
+void UNBodySimulationSubsystem::UpdateSimulationCounters()
+{
+	// No tree is built while the direct solver runs, the fast multipole solver reports its boxes instead
+	int NumTreeNodes = 0;
+	int TreeDepth = 0;
+	if (bTreeIsCurrent)
+	{
+		NumTreeNodes = bUseLinearTree ? LinearQuadTree->NumNodes() : QuadTree->NumNodes();
+		TreeDepth = bUseLinearTree ? LinearQuadTree->GetDepth() : QuadTree->GetDepth();
 	}
+	else if (StepSolver == ENBodySolver::FastMultipole)
+	{
+		NumTreeNodes = FastMultipoleSolver.NumBoxes();
+		TreeDepth = FastMultipoleSolver.GetDepth();
+	}
+	const float InteractionsPerBody = Bodies.Num() > 0 ? StaticCast<float>(TotalSimulationCost) / Bodies.Num() : 0;
+	const float OpenedCellsPerBody = Bodies.Num() > 0 ? StaticCast<float>(TotalOpenedCells) / Bodies.Num() : 0;
+	const int NumActiveBodies = bUseBlockTimeSteps ? BlockTimeStepper.GetActiveBodies().Num() : Bodies.Num();
+
+	SET_DWORD_STAT(NBodySim_NumActiveBodies, NumActiveBodies);
+	SET_DWORD_STAT(NBodySim_NumTreeNodes, NumTreeNodes);
+	SET_DWORD_STAT(NBodySim_TreeDepth, TreeDepth);
+	SET_FLOAT_STAT(NBodySim_InteractionsPerBody, InteractionsPerBody);
+	SET_FLOAT_STAT(NBodySim_OpenedCellsPerBody, OpenedCellsPerBody);
+
+	CSV_CUSTOM_STAT(NBodySim, NumBodies, Bodies.Num(), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(NBodySim, NumActiveBodies, NumActiveBodies, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(NBodySim, NumTreeNodes, NumTreeNodes, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(NBodySim, TreeDepth, TreeDepth, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(NBodySim, InteractionsPerBody, InteractionsPerBody, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(NBodySim, OpenedCellsPerBody, OpenedCellsPerBody, ECsvCustomStatOp::Set);
+}
+
+void UNBodySimulationSubsystem::UpdateMemoryStats()
+{
+	MemoryUsage.Bodies = Bodies.GetMemoryFootprint();
+	MemoryUsage.Bodies += BodyOrder.GetMemoryFootprint();
+	MemoryUsage.Bodies += BlockTimeStepper.GetMemoryFootprint();
+
+	MemoryUsage.Tree = QuadTree->GetMemoryFootprint();
+	MemoryUsage.Tree += LinearQuadTree->GetMemoryFootprint();
+	MemoryUsage.Tree.Add(NodeQuadrupoles);
+	MemoryUsage.Tree += FastMultipoleSolver.GetMemoryFootprint();
+	MemoryUsage.Tree += ParticleMeshSolver.GetMemoryFootprint();
+
+	MemoryUsage.RenderBuffers = FMemoryFootprint();
+	RenderBuffers.ForEachBuffer([this](const FBodyRenderFrame& Buffer)
+	{
+		MemoryUsage.RenderBuffers += Buffer.GetMemoryFootprint();
+	});
+	MemoryUsage.RenderBuffers.Add(ArrayRenderData);
+
+	PeakMemoryUsage.Bodies = FMemoryFootprint::Max(PeakMemoryUsage.Bodies, MemoryUsage.Bodies);
+	PeakMemoryUsage.Tree = FMemoryFootprint::Max(PeakMemoryUsage.Tree, MemoryUsage.Tree);
+	PeakMemoryUsage.RenderBuffers = FMemoryFootprint::Max(PeakMemoryUsage.RenderBuffers, MemoryUsage.RenderBuffers);
+
+	SET_MEMORY_STAT(NBodySim_BodiesMemory, MemoryUsage.Bodies.AllocatedBytes);
+	SET_MEMORY_STAT(NBodySim_TreeMemory, MemoryUsage.Tree.AllocatedBytes);
+	SET_MEMORY_STAT(NBodySim_RenderBuffersMemory, MemoryUsage.RenderBuffers.AllocatedBytes);
+	SET_MEMORY_STAT(NBodySim_PeakBodiesMemory, PeakMemoryUsage.Bodies.AllocatedBytes);
+	SET_MEMORY_STAT(NBodySim_PeakTreeMemory, PeakMemoryUsage.Tree.AllocatedBytes);
+	SET_MEMORY_STAT(NBodySim_PeakRenderBuffersMemory, PeakMemoryUsage.RenderBuffers.AllocatedBytes);
+
+	constexpr float BytesPerMiB = 1024 * 1024;
+	CSV_CUSTOM_STAT(NBodySim, MemoryAllocatedMiB, MemoryUsage.GetTotal().AllocatedBytes / BytesPerMiB,
+	                ECsvCustomStatOp::Set);
+}
+
+void UNBodySimulationSubsystem::UpdateQuadrupoles()
+{
+	NBODYSIM_SCOPE_PHASE(Quadrupoles);
+	LLM_SCOPE_BYTAG(NBodySim_Tree);
+
+	const int NumNodes = bUseLinearTree ? LinearQuadTree->NumNodes() : QuadTree->NumNodes();
+	TQuadrupoleMoments<ETreeBranchSize::QuadTree>::Compute(GetTreeView(), NumNodes, NodeQuadrupoles);
+	bHasQuadrupoles = true;
+}
+
+void UNBodySimulationSubsystem::WarpBodies()
+{
+	NBODYSIM_SCOPE_PHASE(Warp);
+	Bodies.WarpWithinBounds(StepBounds);
+}
+
+void UNBodySimulationSubsystem::ReorderBodies(const float DeltaTime)
+{
+	if (!CVarReorderBodies->GetBool())
+		return;
+
+	NBODYSIM_SCOPE_PHASE(Reorder);
+	LLM_SCOPE_BYTAG(NBodySim_Bodies);
+
+	// Spawned bodies are appended in random order, sort them in once they're a noticeable share of the bodies
+	constexpr float MaxUnsortedFraction = 0.05f;
+
+	// Velocities are the ones the bodies were last integrated with, close enough to how far they'll have moved
+	BodyOrder.AccumulateDrift(Bodies, DeltaTime);
+	if (!BodyOrder.ShouldReorder(StepBounds, CVarReorderDrift->GetFloat(), MaxUnsortedFraction))
+		return;
 
-	for (auto& Future : TaskFutures)
-		Future.Wait();
+	BodyOrder.Reorder(Bodies, StepBounds, NumWorkers);
+
+	// Leaves tracked for refitting are indexed by body, the tree is rebuilt from scratch this step
+	QuadTree->InvalidateBodyLeaves();
 }
 
-// @TODO: Can be much further improved by assigning each thread it's
-// own exclusive quad to populate and combining them at the end
 void UNBodySimulationSubsystem::BatchAndWaitBuildTree(float DeltaTime)
 {
-	QuadTree->Reset(WorldBounds, NumBodies());
+	// Ensure the bodies are actually warped before building the tree,
+	// as this can lead to a crash if they're outside bounds at the time of tree building.
+	WarpBodies();
+
+	NBODYSIM_SCOPE_PHASE(TreeBuild);
+	LLM_SCOPE_BYTAG(NBodySim_Tree);
+
+	// Moments belong to the tree that's about to be replaced
+	bHasQuadrupoles = false;
+
+	// Latch the backend for the whole tick so the force pass walks the tree that was just built
+	bUseLinearTree = CVarTreeBackend->GetInt() == 1;
+	if (bUseLinearTree)
+	{
+		LinearQuadTree->SetLeafCapacity(CVarLeafCapacity->GetInt());
+		LinearQuadTree->Build(StepBounds, Bodies, NumWorkers);
+		return;
+	}
 
-	for (auto& BodyDescriptor : Bodies)
+	// Block time steps still drift every body every tick, refitting keeps the tree & its moments current for less
+	const bool bIncrementalRefit = CVarIncrementalRefit->GetBool() || bUseBlockTimeSteps;
+	if (bIncrementalRefit && QuadTree->Refit(StepBounds, Bodies, NumWorkers, CVarRefitRebuildFraction->GetFloat()))
+		return;
+
+	const int BuildMode = CVarTreeBuildMode->GetInt();
+	if (BuildMode == 1)
+	{
+		QuadTree->BuildParallel(StepBounds, Bodies, NumWorkers);
+	}
+	else if (BuildMode == 2)
+	{
+		QuadTree->BuildConcurrent(StepBounds, Bodies, NumWorkers);
+	}
+	else
 	{
-		QuadTree->Insert(BodyDescriptor);
+		QuadTree->Reset(StepBounds, NumBodies());
+
+		for (int BodyIndex = 0; BodyIndex < Bodies.Num(); BodyIndex++)
+		{
+			QuadTree->Insert(Bodies.Get(BodyIndex), BodyIndex);
+		}
 	}
+
+	if (bIncrementalRefit)
+		QuadTree->TrackBodyLeaves(Bodies.Num(), NumWorkers);
 }
 
-// @TODO: This needs cleanup
-void UNBodySimulationSubsystem::CalculateBodyVelocity(const float DeltaTime, FBodyDescriptor& Body,
-                                                      const TQuadTreeNode& RootNode)
+FTreeWalkStats UNBodySimulationSubsystem::CalculateBodyVelocity(const float DeltaTime, FBodyDescriptor& Body,
+                                                                const uint32 BodyIndex, const TQuadTreeView& Tree)
+{
+	FVector2f Velocity(0);
+	const FVector2f Location = Body.Location;
+
+	auto Visitor = [&Velocity, Location](const FVector2f OtherLocation, const float OtherMass)
+	{
+		const FVector2f Dist = OtherLocation - Location;
+		Velocity += Dist * (OtherMass / Dist.SquaredLength());
+	};
+
+	FTreeWalkStats WalkStats;
+	if (Tree.Quadrupoles)
+	{
+		WalkStats = TTreeWalker<ETreeBranchSize::QuadTree>::Walk(Tree, Location, BodyIndex, AccuracyCoefficient,
+			Visitor, [&Velocity, Location, &Tree](const TQuadTreeNode& Node, const uint32 NodeIndex)
+			{
+				const FVector2f Dist = Node.CenterOfMass - Location;
+				Velocity += Dist * (Node.Mass / Dist.SquaredLength());
+				Velocity += TQuadrupoleMoments<ETreeBranchSize::QuadTree>::Evaluate(Dist, Tree.Quadrupoles[NodeIndex]);
+			});
+	}
+	else
+	{
+		WalkStats = TTreeWalker<ETreeBranchSize::QuadTree>::Walk(Tree, Location, BodyIndex, AccuracyCoefficient,
+			Visitor);
+	}
+
+	Body.Velocity += Velocity;
+	Body.SimCost += WalkStats.NumAccepted;
+	return WalkStats;
+}
+
+FTreeWalkStats UNBodySimulationSubsystem::GatherInteractions(const FBodyDescriptor& Body, const uint32 BodyIndex,
+                                                             const TQuadTreeView& Tree, FInteractionList& Interactions)
 {
-	const bool bIsSameBody = RootNode.BodyDescriptor == Body;
-	if (!bIsSameBody)
-		if (RootNode.IsSingleton())
+	return TTreeWalker<ETreeBranchSize::QuadTree>::Walk(Tree, Body.Location, BodyIndex, AccuracyCoefficient,
+		[&Interactions](const FVector2f OtherLocation, const float OtherMass)
 		{
-			const FVector2f Dist = RootNode.BodyDescriptor.Location - Body.Location;
-			const auto Force = Dist * (RootNode.BodyDescriptor.Mass / Dist.SquaredLength());
+			Interactions.Add(OtherLocation, OtherMass);
+		});
+}
 
-			Body.Velocity += Force;
-			++Body.SimCost;
-		}
-		else if (RootNode.IsCluster())
+FTreeWalkStats UNBodySimulationSubsystem::CalculateBucketVelocities(const uint32 BucketNodeIndex,
+                                                                    const TQuadTreeView& Tree,
+                                                                    FInteractionList& Interactions)
+{
+	const TQuadTreeNode& Bucket = Tree.GetNode(BucketNodeIndex);
+	const uint32 BucketEnd = Bucket.FirstBody + Bucket.NumBodies;
+
+	FVector2f BucketMin = Tree.GetLeafBodyLocation(Bucket.FirstBody);
+	FVector2f BucketMax = BucketMin;
+	for (uint32 LeafBody = Bucket.FirstBody + 1; LeafBody < BucketEnd; LeafBody++)
+	{
+		const FVector2f Location = Tree.GetLeafBodyLocation(LeafBody);
+		BucketMin = FVector2f::Min(BucketMin, Location);
+		BucketMax = FVector2f::Max(BucketMax, Location);
+	}
+
+	// One walk for the whole bucket, every body in it shares the far field
+	Interactions.Reset();
+	FTreeWalkStats WalkStats = TTreeWalker<ETreeBranchSize::QuadTree>::WalkBucket(Tree, BucketNodeIndex, BucketMin,
+		BucketMax, AccuracyCoefficient, [&Interactions](const FVector2f OtherLocation, const float OtherMass)
 		{
-			// Accuracy coefficient factor
-			// Node width / distance
-			const float DistanceToNode = (RootNode.BodyDescriptor.Location - Body.Location).Length();
-			const float AccuracyFactor = RootNode.NodeBounds.Length() / DistanceToNode;
+			Interactions.Add(OtherLocation, OtherMass);
+		});
 
-			if (AccuracyFactor < AccuracyCoefficient)
-			{
-				const FVector2f Dist = RootNode.BodyDescriptor.Location - Body.Location;
-				const auto Force = Dist * (RootNode.BodyDescriptor.Mass / Dist.SquaredLength());
+	for (uint32 LeafBody = Bucket.FirstBody; LeafBody < BucketEnd; LeafBody++)
+	{
+		const FVector2f Location = Tree.GetLeafBodyLocation(LeafBody);
+		FVector2f Velocity = FForceKernel::Evaluate(Location, Interactions);
 
-				Body.Velocity += Force;
-				++Body.SimCost;
-			}
-			else
-			{
-				// loop inner nodes
-				for (const TTreeNode<ETreeBranchSize::QuadTree>& Node : RootNode)
-					CalculateBodyVelocity(DeltaTime, Body, Node);
-			}
+		// Near field, every other body of the same bucket directly
+		for (uint32 OtherBody = Bucket.FirstBody; OtherBody < BucketEnd; OtherBody++)
+		{
+			if (OtherBody == LeafBody)
+				continue;
+
+			const FVector2f Dist = Tree.GetLeafBodyLocation(OtherBody) - Location;
+			Velocity += Dist * (Tree.LeafMass[OtherBody] / Dist.SquaredLength());
 		}
+
+		const uint32 BodyIndex = Tree.LeafBodyIndices[LeafBody];
+		Bodies.SetVelocity(BodyIndex, Bodies.GetVelocity(BodyIndex) + Velocity);
+		Bodies.Cost[BodyIndex] = Interactions.Num() + Bucket.NumBodies - 1;
+	}
+
+	WalkStats.NumAccepted = (Interactions.Num() + Bucket.NumBodies - 1) * Bucket.NumBodies;
+	return WalkStats;
 }
 
 FQuadrantBounds UNBodySimulationSubsystem::GetWorldBounds() const
@@ -340,6 +1270,41 @@ FQuadrantBounds UNBodySimulationSubsystem::GetWorldBounds() const
 	return WorldBounds;
 }
 
+FBodyDescriptor UNBodySimulationSubsystem::GetBody(const int Index)
+{
+	WaitForSimulationTask();
+	const int BodyIndex = BodyOrder.GetBodyIndex(Index);
+	if (!Bodies.IsValidIndex(BodyIndex))
+		return FBodyDescriptor();
+
+	return Bodies.Get(BodyIndex);
+}
+
+void UNBodySimulationSubsystem::SetBody(const int Index, const FBodyDescriptor& Body)
+{
+	WaitForSimulationTask();
+	const int BodyIndex = BodyOrder.GetBodyIndex(Index);
+	if (Bodies.IsValidIndex(BodyIndex))
+		Bodies.Set(BodyIndex, Body);
+}
+
+TQuadTreeView UNBodySimulationSubsystem::GetTreeView() const
+{
+	TQuadTreeView View = bUseLinearTree ? LinearQuadTree->GetView() : QuadTree->GetView();
+	if (bHasQuadrupoles)
+		View.Quadrupoles = NodeQuadrupoles.GetData();
+
+	return View;
+}
+
+TArrayView<const uint32> UNBodySimulationSubsystem::GetSpatialBodyOrder() const
+{
+	if (bUseLinearTree)
+		return LinearQuadTree->GetSortedBodyIndices();
+
+	return QuadTree->GetSortedBodyIndices();
+}
+
 
 void UNBodySimulationSubsystem::OnViewportResizedCallback(FViewport* Viewport, unsigned I)
 {
@@ -381,12 +1346,20 @@ void UNBodySimulationSubsystem::UpdateCameraWorldBounds()
 void UNBodySimulationSubsystem::TickDebug(float DeltaTime)
 {
 #if !UE_BUILD_SHIPPING
-	DebugDrawTreeBounds(DeltaTime, *QuadTree);
+	NBODYSIM_SCOPE_PHASE(Debug);
+
+	// Whatever tree is left from an earlier step doesn't match the bodies anymore
+	if (!bTreeIsCurrent)
+		return;
+
+	const TQuadTreeView Tree = GetTreeView();
+	DebugDrawTreeBounds(DeltaTime, Tree, Tree.GetRootNode(), Tree.RootBounds);
 #endif
 }
 
 
-void UNBodySimulationSubsystem::DebugDrawTreeBounds(float DeltaTime, TQuadTreeNode& Node)
+void UNBodySimulationSubsystem::DebugDrawTreeBounds(float DeltaTime, const TQuadTreeView& Tree,
+                                                    const TQuadTreeNode& Node, const FQuadrantBounds& NodeBounds)
 {
 #if !UE_BUILD_SHIPPING
 	if (!CVarDrawTreeBounds->GetBool())
@@ -394,10 +1367,10 @@ void UNBodySimulationSubsystem::DebugDrawTreeBounds(float DeltaTime, TQuadTreeNo
 
 	if (Node.IsEmpty())
 		return;
-	const FVector2f Center = Node.NodeBounds.Midpoint();
+	const FVector2f Center = NodeBounds.Midpoint();
 
 	DrawDebugBox(GetWorld(), FVector(Center.X, Center.Y, 0),
-	             FVector(Node.NodeBounds.HorizontalSize() * 0.5, Node.NodeBounds.VerticalSize() * 0.5, 0),
+	             FVector(NodeBounds.HorizontalSize() * 0.5, NodeBounds.VerticalSize() * 0.5, 0),
 	             FColor::Green, false, DeltaTime, 0, 30);
 
 	DrawDebugPoint(GetWorld(), FVector(Center.X, Center.Y, 0), 10, FColor::Red, false,
@@ -405,8 +1378,10 @@ void UNBodySimulationSubsystem::DebugDrawTreeBounds(float DeltaTime, TQuadTreeNo
 
 	if (Node.IsCluster())
 	{
-		for (TQuadTreeNode& SubNode : Node)
-			DebugDrawTreeBounds(DeltaTime, SubNode);
+		// Bounds aren't stored in the nodes, rebuild them on the way down
+		for (int QuadIndex = 0; QuadIndex < ETreeBranchSize::QuadTree; QuadIndex++)
+			DebugDrawTreeBounds(DeltaTime, Tree, Tree.GetNode(Node.GetChildIndex(QuadIndex)),
+			                    NodeBounds.GetQuadrantBounds(QuadIndex));
 	}
 #endif
 }
@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Game/NiagaraDataInterfaceNBodyBodies.h"
+#include "Game/NBodySimulationSubsystem.h"
+#include "NiagaraSystemInstance.h"
+#include "NiagaraTypes.h"
+
+namespace NDINBodyBodies
+{
+	static const FName GetNumBodiesName(TEXT("GetNumBodies"));
+	static const FName GetNumNewBodiesName(TEXT("GetNumNewBodies"));
+	static const FName GetBodyName(TEXT("GetBody"));
+}
+
+void UNiagaraDataInterfaceNBodyBodies::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	// Lets the data interface be used as a user parameter & in any script variable
+	if (HasAnyFlags(RF_ClassDefaultObject))
+	{
+		const ENiagaraTypeRegistryFlags Flags = ENiagaraTypeRegistryFlags::AllowAnyVariable |
+			ENiagaraTypeRegistryFlags::AllowParameter;
+		FNiagaraTypeRegistry::Register(FNiagaraTypeDefinition(GetClass()), Flags);
+	}
+}
+
+void UNiagaraDataInterfaceNBodyBodies::GetFunctions(TArray<FNiagaraFunctionSignature>& OutFunctions)
+{
+	FNiagaraFunctionSignature BaseSignature;
+	BaseSignature.bMemberFunction = true;
+	BaseSignature.bRequiresContext = false;
+	BaseSignature.bSupportsGPU = false;
+	BaseSignature.Inputs.Add(FNiagaraVariable(FNiagaraTypeDefinition(GetClass()), TEXT("Bodies")));
+
+	{
+		FNiagaraFunctionSignature& Signature = OutFunctions.Add_GetRef(BaseSignature);
+		Signature.Name = NDINBodyBodies::GetNumBodiesName;
+		Signature.Outputs.Add(FNiagaraVariable(FNiagaraTypeDefinition::GetIntDef(), TEXT("NumBodies")));
+	}
+	{
+		FNiagaraFunctionSignature& Signature = OutFunctions.Add_GetRef(BaseSignature);
+		Signature.Name = NDINBodyBodies::GetNumNewBodiesName;
+		Signature.Outputs.Add(FNiagaraVariable(FNiagaraTypeDefinition::GetIntDef(), TEXT("NumNewBodies")));
+	}
+	{
+		FNiagaraFunctionSignature& Signature = OutFunctions.Add_GetRef(BaseSignature);
+		Signature.Name = NDINBodyBodies::GetBodyName;
+		Signature.Inputs.Add(FNiagaraVariable(FNiagaraTypeDefinition::GetIntDef(), TEXT("Index")));
+		Signature.Outputs.Add(FNiagaraVariable(FNiagaraTypeDefinition::GetBoolDef(), TEXT("IsValid")));
+		Signature.Outputs.Add(FNiagaraVariable(FNiagaraTypeDefinition::GetVec2Def(), TEXT("Location")));
+		Signature.Outputs.Add(FNiagaraVariable(FNiagaraTypeDefinition::GetFloatDef(), TEXT("Mass")));
+	}
+}
+
+void UNiagaraDataInterfaceNBodyBodies::GetVMExternalFunction(const FVMExternalFunctionBindingInfo& BindingInfo,
+                                                             void* InstanceData, FVMExternalFunction& OutFunc)
+{
+	if (BindingInfo.Name == NDINBodyBodies::GetNumBodiesName)
+		OutFunc = FVMExternalFunction::CreateStatic(&UNiagaraDataInterfaceNBodyBodies::VMGetNumBodies);
+	else if (BindingInfo.Name == NDINBodyBodies::GetNumNewBodiesName)
+		OutFunc = FVMExternalFunction::CreateStatic(&UNiagaraDataInterfaceNBodyBodies::VMGetNumNewBodies);
+	else if (BindingInfo.Name == NDINBodyBodies::GetBodyName)
+		OutFunc = FVMExternalFunction::CreateStatic(&UNiagaraDataInterfaceNBodyBodies::VMGetBody);
+}
+
+bool UNiagaraDataInterfaceNBodyBodies::InitPerInstanceData(void* PerInstanceData,
+                                                          FNiagaraSystemInstance* SystemInstance)
+{
+	FNDINBodyBodiesInstanceData* InstanceData = new(PerInstanceData) FNDINBodyBodiesInstanceData();
+
+	const UWorld* World = SystemInstance->GetWorld();
+	InstanceData->Subsystem = World ? World->GetSubsystem<UNBodySimulationSubsystem>() : nullptr;
+	return true;
+}
+
+void UNiagaraDataInterfaceNBodyBodies::DestroyPerInstanceData(void* PerInstanceData,
+                                                             FNiagaraSystemInstance* SystemInstance)
+{
+	StaticCast<FNDINBodyBodiesInstanceData*>(PerInstanceData)->~FNDINBodyBodiesInstanceData();
+}
+
+bool UNiagaraDataInterfaceNBodyBodies::PerInstanceTick(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance,
+                                                       float DeltaSeconds)
+{
+	FNDINBodyBodiesInstanceData* InstanceData = StaticCast<FNDINBodyBodiesInstanceData*>(PerInstanceData);
+
+	UNBodySimulationSubsystem* Subsystem = InstanceData->Subsystem.Get();
+	InstanceData->Frame = Subsystem ? &Subsystem->AcquireRenderFrame() : nullptr;
+
+	// Bodies are never removed, the body count only shrinks when the simulation restarts
+	const int NumBodies = InstanceData->Frame ? InstanceData->Frame->Num() : 0;
+	InstanceData->NumNewBodies = FMath::Max(NumBodies - InstanceData->NumPreviousBodies, 0);
+	InstanceData->NumPreviousBodies = NumBodies;
+
+	// Never asks for a reset, new bodies are spawned on top of the existing particles
+	return false;
+}
+
+void UNiagaraDataInterfaceNBodyBodies::VMGetNumBodies(FVectorVMExternalFunctionContext& Context)
+{
+	VectorVM::FUserPtrHandler<FNDINBodyBodiesInstanceData> InstanceData(Context);
+	FNDIOutputParam<int32> OutNumBodies(Context);
+
+	const int NumBodies = InstanceData->Frame ? InstanceData->Frame->Num() : 0;
+	for (int32 i = 0; i < Context.GetNumInstances(); i++)
+		OutNumBodies.SetAndAdvance(NumBodies);
+}
+
+void UNiagaraDataInterfaceNBodyBodies::VMGetNumNewBodies(FVectorVMExternalFunctionContext& Context)
+{
+	VectorVM::FUserPtrHandler<FNDINBodyBodiesInstanceData> InstanceData(Context);
+	FNDIOutputParam<int32> OutNumNewBodies(Context);
+
+	for (int32 i = 0; i < Context.GetNumInstances(); i++)
+		OutNumNewBodies.SetAndAdvance(InstanceData->NumNewBodies);
+}
+
+void UNiagaraDataInterfaceNBodyBodies::VMGetBody(FVectorVMExternalFunctionContext& Context)
+{
+	VectorVM::FUserPtrHandler<FNDINBodyBodiesInstanceData> InstanceData(Context);
+	FNDIInputParam<int32> InIndex(Context);
+	FNDIOutputParam<bool> OutIsValid(Context);
+	FNDIOutputParam<FVector2f> OutLocation(Context);
+	FNDIOutputParam<float> OutMass(Context);
+
+	const FBodyRenderFrame* Frame = InstanceData->Frame;
+	for (int32 i = 0; i < Context.GetNumInstances(); i++)
+	{
+		const int32 Index = InIndex.GetAndAdvance();
+		FVector2f Location = FVector2f::ZeroVector;
+		float Mass = 0;
+		const bool bIsValid = Frame && Frame->GetBody(Index, Location, Mass);
+
+		OutIsValid.SetAndAdvance(bIsValid);
+		OutLocation.SetAndAdvance(Location);
+		OutMass.SetAndAdvance(Mass);
+	}
+}
@@ -1,8 +1,11 @@
 #pragma once
 #include "TreeNode.h"
+#include "BodyArray.h"
+#include "Async/ParallelFor.h"
 
-typedef TTreeNode<ETreeBranchSize::QuadTree> TQuadTreeNode; 
-typedef TTreeNode<ETreeBranchSize::Octree> TOctreeNode; 
+typedef TTreeNode<ETreeBranchSize::QuadTree> TQuadTreeNode;
+typedef TTreeNode<ETreeBranchSize::Octree> TOctreeNode;
+typedef TTreeView<ETreeBranchSize::QuadTree> TQuadTreeView;
 
 /**
  * @brief Guaranteed to always have a root node.
@@ -15,13 +18,72 @@ class TBarnesHutTree
 private:
 	TArray<TTreeNode<BranchSize>> InternalNodesArr;
 
+	FQuadrantBounds TreeBounds;
+
 	// If node bounds length is less than this, no new leaves will be created.
 	// This is used to avoid infinite recursion considering we have no collision detection.
 	// Nodes will still be updated, bodies will still have their masses taken into account for the sim.
 	// Currently calculated to be 0.5% of the ortho cam width
 	// @TODO: Move this to a more configurable place
 	const float MinNodeSize;
-	
+
+	// Deepest level any node was created at
+	int MaxNodeDepth = 0;
+
+	// Parallel build state, kept around between frames to avoid reallocating every build
+	// Subtrees owned by each cell under the stitched top levels of the tree
+	TArray<TUniquePtr<TBarnesHutTree>> SubTrees;
+	// Cell each body was bucketed into
+	TArray<int> BodyCells;
+	// Prefix sum of body counts per cell, cell N owns [CellStarts[N], CellStarts[N + 1]) in CellBodyIndices
+	TArray<int> CellStarts;
+	// Body indices sorted by cell, cells are numbered in Z order so this is also a coarse spatial order
+	TArray<uint32> CellBodyIndices;
+	// Where the non root nodes of each subtree are copied to in the internal array
+	TArray<uint32> SubTreeOffsets;
+
+	// Deepest level the parallel build will split the top of the tree at, 4^4 = 256 cells
+	static constexpr int MaxSplitDepth = 4;
+
+	// Incremental refit state, see Refit
+	// Singleton each body is held by & its bounds (left, right, top, bottom), valid while bCanRefit is set
+	TArray<uint32> BodyLeafNodes;
+	TArray<FVector4f> BodyLeafBounds;
+	// Whether every body is tracked, bodies folded into a minimum size cluster aren't
+	bool bCanRefit = false;
+	// Set whenever an insertion folds a body into a minimum size cluster
+	bool bHasFoldedBodies = false;
+	// Bodies re-inserted since the last full build, the tree degrades a little with every one
+	int NumReinsertedBodies = 0;
+	// Scratch of the refit passes, which bodies left their leaf
+	TArray<uint8> BodyLeftLeaf;
+	TArray<uint32> LeftLeafBodies;
+
+	// Nodes the parallel bottom-up passes are split at, see CollectSplitRoots
+	TArray<TPair<uint32, FQuadrantBounds>> SplitRoots;
+
+	// Concurrent build state, see BuildConcurrent
+	// Nodes handed out to each insertion task at once, a multiple of BranchSize so child blocks never straddle chunks
+	static constexpr uint32 NodePoolChunkSize = 256 * BranchSize;
+	// Range of the internal array an insertion task allocates child blocks from
+	struct FNodePool
+	{
+		uint32 Next = 0;
+		uint32 End = 0;
+		int MaxDepth = 0;
+	};
+	TArray<int> TaskMaxDepths;
+	// Node array size the last concurrent build fit in, the next one starts from it instead of running out again
+	uint32 ConcurrentNodeCapacity = 0;
+	// Scratch the nodes are laid out again into, where every split root & its descendants are copied to
+	TArray<TTreeNode<BranchSize>> RelayoutNodes;
+	TArray<uint32> SplitRootDestinations;
+	TArray<uint32> SplitRootOffsets;
+
+	explicit TBarnesHutTree(const float InMinNodeSize) : MinNodeSize(InMinNodeSize)
+	{
+	}
+
 public:
 	/**
 	 * @brief A QuadTree implementation for the Barnes Hut algorithm.
@@ -33,102 +95,286 @@ public:
 		Reset(WorldBounds, NumElements);
 	}
 
-	FORCEINLINE operator TTreeNode<BranchSize>&() { return GetRootNode(); }
-	FORCEINLINE operator TTreeNode<BranchSize>*() { return &GetRootNode(); }
-
-	FORCEINLINE typename TTreeNode<BranchSize>::FIterator begin() { return GetRootNode().begin(); }
-	FORCEINLINE typename TTreeNode<BranchSize>::FIterator end() { return GetRootNode().end(); }
-
 	FORCEINLINE void Reset(FQuadrantBounds WorldBounds)
 	{
+		TreeBounds = WorldBounds;
 		InternalNodesArr.Reset();
-		InternalNodesArr.Insert(TTreeNode(WorldBounds), 0);
+		InternalNodesArr.Emplace(StaticCast<uint8>(0));
+		CellBodyIndices.Reset();
+		MaxNodeDepth = 0;
+		bCanRefit = false;
+		bHasFoldedBodies = false;
 	}
 
 	FORCEINLINE void Reset(FQuadrantBounds WorldBounds, const int NumElements)
 	{
+		TreeBounds = WorldBounds;
 		InternalNodesArr.Reset(BranchSize * NumElements + 1);
-		InternalNodesArr.Insert(TTreeNode<BranchSize>(WorldBounds), 0);
+		InternalNodesArr.Emplace(StaticCast<uint8>(0));
+		CellBodyIndices.Reset();
+		MaxNodeDepth = 0;
+		bCanRefit = false;
+		bHasFoldedBodies = false;
 	}
 
-
 	FORCEINLINE TTreeNode<BranchSize>& GetRootNode() { return InternalNodesArr[0]; }
 
-	FORCEINLINE bool Insert(const FBodyDescriptor& Body)
+	FORCEINLINE int NumNodes() const { return InternalNodesArr.Num(); }
+
+	/**
+	 * @brief Depth of the deepest node, the root being at depth 0.
+	 */
+	FORCEINLINE int GetDepth() const { return MaxNodeDepth; }
+
+	FORCEINLINE TTreeView<BranchSize> GetView() const
 	{
-		return InsertInternal(GetRootNode(), Body);
+		return TTreeView<BranchSize>(InternalNodesArr.GetData(), TreeBounds);
 	}
 
-private:
-	void UpdateNodeMass(TTreeNode<BranchSize>& Node, const FBodyDescriptor& Body);
-	bool InsertInternal(TTreeNode<BranchSize>& Node, const FBodyDescriptor& Body);
-	
 	/**
-	 * @brief Attempts to pool a new node from the existing array, or add a new node (Expanding the array) if
-	 * there aren't free nodes left.
-	 * @param Bounds Bounds to initialize the node with
-	 * @return 
+	 * @brief Every body index ordered by the top level cell it was built in, empty unless built with BuildParallel.
+	 */
+	FORCEINLINE TArrayView<const uint32> GetSortedBodyIndices() const { return CellBodyIndices; }
+
+	/**
+	 * @brief Memory held by the nodes & the parallel build state, subtrees included.
+	 */
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(InternalNodesArr);
+		Footprint.Add(SubTrees);
+		Footprint.Add(BodyCells);
+		Footprint.Add(CellStarts);
+		Footprint.Add(CellBodyIndices);
+		Footprint.Add(SubTreeOffsets);
+		Footprint.Add(BodyLeafNodes);
+		Footprint.Add(BodyLeafBounds);
+		Footprint.Add(BodyLeftLeaf);
+		Footprint.Add(LeftLeafBodies);
+		Footprint.Add(SplitRoots);
+		Footprint.Add(TaskMaxDepths);
+		Footprint.Add(RelayoutNodes);
+		Footprint.Add(SplitRootDestinations);
+		Footprint.Add(SplitRootOffsets);
+		for (const TUniquePtr<TBarnesHutTree>& SubTree : SubTrees)
+		{
+			Footprint.UsedBytes += sizeof(TBarnesHutTree);
+			Footprint.AllocatedBytes += sizeof(TBarnesHutTree);
+			Footprint += SubTree->GetMemoryFootprint();
+		}
+		return Footprint;
+	}
+
+	/**
+	 * @param Body The body to insert
+	 * @param BodyIndex Index of the body, stored in its leaf so walks can skip self interaction
+	 */
+	FORCEINLINE bool Insert(const FBodyDescriptor& Body, const uint32 BodyIndex)
+	{
+		return InsertInternal(0, TreeBounds, Body, BodyIndex);
+	}
+
+	/**
+	 * @brief Rebuilds the tree from scratch on all available workers.
+	 * Bodies are bucketed into the cells found SplitDepth levels below the root, each cell is built into its own
+	 * subtree in parallel using the regular insertion path, and the subtrees are stitched under the top levels of
+	 * the tree at the end. Masses & centers of mass match the serial path up to float rounding.
+	 * @param WorldBounds World bounds to start the tree with
+	 * @param Bodies The bodies to build the tree from
+	 * @param NumWorkers The number of workers available, used to pick how many cells to split into
+	 */
+	void BuildParallel(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies, const int NumWorkers);
+
+	/**
+	 * @brief Rebuilds the tree from scratch with every worker inserting into the same tree at once.
+	 * Workers claim a node by compare and swapping its type to Locked, and take child blocks from their own chunk of
+	 * the node array so they never contend on allocation. Insertion leaves masses alone, they're computed by a
+	 * parallel bottom-up pass once every body is in rather than updated all the way down by every insert. The nodes
+	 * are then laid out again depth first, children following their parent as in every other build.
+	 * @param WorldBounds World bounds to start the tree with
+	 * @param Bodies The bodies to build the tree from
+	 * @param NumWorkers The number of workers available, used to pick how many insertion tasks to run
 	 */
-	TTreeNode<BranchSize>& MakeNewNode(const FQuadrantBounds& Bounds);
+	void BuildConcurrent(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies, const int NumWorkers);
 
 	/**
-	 * @brief Transforms a node from singleton to cluster
-	 * 
-	 * @param Node The node to upgrade from singleton to cluster
+	 * @brief Records the leaf holding every body, so the next steps can be refit rather than rebuilt.
+	 * Call after a full build, with the bodies it was built from.
+	 * @param NumBodies Number of bodies the tree was built from
+	 * @param NumWorkers The number of workers available, used to pick how far down the pass is split
+	 */
+	void TrackBodyLeaves(const int NumBodies, const int NumWorkers);
+
+	/**
+	 * @brief Updates the tree for the bodies' new locations instead of rebuilding it.
+	 * Bodies still within their leaf only update it, the others are removed & inserted again from the root, then
+	 * every cluster's mass & center of mass are recomputed bottom-up in parallel. Clusters left without bodies
+	 * become empty, but nodes are never merged back, so the tree slowly drifts from what a full build would give.
+	 * @param WorldBounds World bounds, must match the ones the tree was built with
+	 * @param Bodies The bodies the tree was built from, at their new locations
+	 * @param NumWorkers The number of workers available, used to pick how far down the pass is split
+	 * @param MaxReinsertedFraction Fraction of the bodies that may be re-inserted since the last full build
+	 * @return Whether the tree was refit, when false it's left unusable until the next full build
+	 */
+	bool Refit(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies, const int NumWorkers,
+	           const float MaxReinsertedFraction);
+
+	/**
+	 * @brief Stops refitting until the next full build, for when bodies were moved around in their array & no longer
+	 * match the leaves tracked for them.
+	 */
+	FORCEINLINE void InvalidateBodyLeaves() { bCanRefit = false; }
+
+	/**
+	 * @brief Bodies re-inserted by every refit since the last full build.
+	 */
+	FORCEINLINE int GetNumReinsertedBodies() const { return NumReinsertedBodies; }
+
+private:
+	void UpdateNodeMass(TTreeNode<BranchSize>& Node, const FBodyDescriptor& Body, const uint32 BodyIndex);
+	bool InsertInternal(const uint32 NodeIndex, const FQuadrantBounds& NodeBounds, const FBodyDescriptor& Body,
+	                    const uint32 BodyIndex);
+
+	/**
+	 * @brief Transforms a node from singleton to cluster, appending its BranchSize children to the internal array.
+	 * Any reference into the internal array is invalidated.
+	 *
+	 * @param NodeIndex The node to upgrade from singleton to cluster
+	 * @param OutExistingBodyIndex Index of the body that existed inside the node pre-transform
 	 * @return The body that existed inside the node pre-transform
 	 */
-	FBodyDescriptor MakeClusterNode(TTreeNode<BranchSize>& Node);
+	FBodyDescriptor MakeClusterNode(const uint32 NodeIndex, uint32& OutExistingBodyIndex);
+
+	/**
+	 * @brief Finds the bounds of a parallel build cell by walking down from the world bounds, using the same
+	 * operations as GetQuadrantLocation so bodies on cell edges land in the same cell the serial path would pick.
+	 */
+	static FQuadrantBounds GetCellBounds(const FQuadrantBounds& WorldBounds, const int Cell, const int SplitDepth);
+
+	/**
+	 * @brief Recursively builds the top levels of the tree above the parallel built subtrees and links them together.
+	 * Subtree roots are expected at [NumTopNodes, NumTopNodes + NumCells) in cell order.
+	 * @param NodeIndex Index of the node to build in the internal array
+	 * @param CellPrefix Cell path of the node so far, one base BranchSize digit per level
+	 * @param SplitDepth Depth at which the subtrees are linked
+	 * @param NumTopNodes Number of nodes above the split
+	 * @return The number of bodies below the node
+	 */
+	int StitchSubTrees(const uint32 NodeIndex, const int CellPrefix, const int SplitDepth, const uint32 NumTopNodes);
+
+	/**
+	 * @brief Inserts a body while other workers insert into the same tree, see BuildConcurrent.
+	 * Only safe while the internal array isn't resized, and only singletons hold a mass until UpdateClusterMass runs.
+	 * @param Pool Insertion task's pool, refilled from NextFreeNode
+	 * @param NextFreeNode First node of the internal array no pool was handed yet
+	 * @return False if the internal array ran out of nodes, the body wasn't inserted
+	 */
+	bool InsertConcurrent(const FBodyDescriptor& Body, const uint32 BodyIndex, FNodePool& Pool,
+	                      std::atomic<uint32>& NextFreeNode);
+
+	/**
+	 * @brief Copies the children of a node into the relayout scratch at Cursor, pointing its copy at Destination to
+	 * them.
+	 * @return The cursor past the copied children
+	 */
+	uint32 CopyChildBlock(const uint32 NodeIndex, const uint32 Destination, const uint32 Cursor);
+
+	/**
+	 * @brief Lays out the nodes above the split roots, recording where every split root was copied to.
+	 * Visits the split roots in the same order as CollectSplitRoots.
+	 */
+	void RelayoutTopLevels(const uint32 NodeIndex, const uint32 Destination, uint32& Cursor, const int SplitDepth);
+
+	/**
+	 * @brief Lays out every descendant of a node depth first from Cursor, the node being already copied to Destination.
+	 * @return The cursor past the last copied node
+	 */
+	uint32 RelayoutDescendants(const uint32 NodeIndex, const uint32 Destination, uint32 Cursor);
+
+	/**
+	 * @brief Number of nodes below a node.
+	 */
+	int CountDescendants(const uint32 NodeIndex) const;
+
+	/**
+	 * @brief Gathers the nodes the bottom-up passes run in parallel from, every node at the split depth & every leaf
+	 * above it, with their bounds.
+	 */
+	void CollectSplitRoots(const uint32 NodeIndex, const FQuadrantBounds& NodeBounds, const int SplitDepth);
+
+	/**
+	 * @brief Records every singleton below a node as its body's leaf.
+	 * @return The number of singletons found
+	 */
+	int TrackLeavesBelow(const uint32 NodeIndex, const FQuadrantBounds& NodeBounds);
+
+	/**
+	 * @brief Recomputes the mass & center of mass of a cluster from its children, recursing into children above
+	 * StopDepth first. Clusters left without mass become empty.
+	 */
+	void UpdateClusterMass(const uint32 NodeIndex, const int StopDepth);
+
+	/**
+	 * @brief Number of levels below the root the parallel passes split the tree at.
+	 */
+	static int GetSplitDepth(const int NumWorkers);
 };
 
 template<int BranchSize>
-void TBarnesHutTree<BranchSize>::UpdateNodeMass(TTreeNode<BranchSize>& Node, const FBodyDescriptor& Body)
+void TBarnesHutTree<BranchSize>::UpdateNodeMass(TTreeNode<BranchSize>& Node, const FBodyDescriptor& Body,
+                                                const uint32 BodyIndex)
 {
 	if(Node.IsCluster())
 	{
-		// CoM = (M1 * P1 + M2 * P2) / TotalMass
-		const auto M1P1 = Node.BodyDescriptor.Mass * Node.BodyDescriptor.Location;
-		const auto M2P2 = Body.Mass * Body.Location;
-		const auto TotalMass = Body.Mass + Node.BodyDescriptor.Mass;
-
-		Node.BodyDescriptor.Location = (M1P1 + M2P2) / TotalMass;
-
-		// Update total mass
-		Node.BodyDescriptor.Mass = TotalMass;
+		Node.AccumulateMass(Body);
 	}
 	else
 	{
-		Node.BodyDescriptor.Location = Body.Location;
-		Node.BodyDescriptor.Mass = Body.Mass;
+		Node.SetBody(Body, BodyIndex);
 	}
 }
 template<int BranchSize>
-bool TBarnesHutTree<BranchSize>::InsertInternal(TTreeNode<BranchSize>& Node, const FBodyDescriptor& Body)
+bool TBarnesHutTree<BranchSize>::InsertInternal(const uint32 NodeIndex, const FQuadrantBounds& NodeBounds,
+                                                const FBodyDescriptor& Body, const uint32 BodyIndex)
 {
-	check(Node.NodeBounds.IsWithinBounds(Body.Location));
+	check(NodeBounds.IsWithinBounds(Body.Location));
 
+	TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
 	switch (Node.NodeType)
 	{
 	// If cluster type node, attempt to insert into the quadrant we belong to
 	case ENodeType::Cluster:
 		{
-			const EQuadrantLocation QuadLocation = Node.NodeBounds.GetQuadrantLocation(Body.Location);
+			const EQuadrantLocation QuadLocation = NodeBounds.GetQuadrantLocation(Body.Location);
 			check(QuadLocation < EQuadrantLocation::Outside);
 
-			UpdateNodeMass(Node, Body);
-			
+			UpdateNodeMass(Node, Body, BodyIndex);
+
 			// Given we can have many bodies in the same spot, we'll opt not to create extra nodes below a certain size
 			// We're adding their mass to this node's pseudo body descriptor so they'll still be calculated for other bodies.
-			if (Node.NodeBounds.Length() <= MinNodeSize)
+			if (NodeBounds.Length() <= MinNodeSize)
+			{
+				bHasFoldedBodies = true;
 				return true;
-			
-			return InsertInternal(Node.GetLeaf(QuadLocation), Body);
+			}
+
+			return InsertInternal(Node.GetChildIndex(QuadLocation), NodeBounds.GetQuadrantBounds(QuadLocation), Body,
+			                      BodyIndex);
 		}
 
 	// If this node is still empty, place the body here directly & update accordingly.
 	case ENodeType::Empty:
 		{
 			Node.NodeType = ENodeType::Singleton;
-			UpdateNodeMass(Node, Body);
+			UpdateNodeMass(Node, Body, BodyIndex);
+
+			// Bodies moved around by a refit keep their leaf up to date, a full build tracks them all at the end
+			if (bCanRefit)
+			{
+				BodyLeafNodes[BodyIndex] = NodeIndex;
+				BodyLeafBounds[BodyIndex] = NodeBounds.Vec;
+			}
 			return true;
 		}
 
@@ -136,10 +382,11 @@ bool TBarnesHutTree<BranchSize>::InsertInternal(TTreeNode<BranchSize>& Node, con
 	// both bodies recursively down the tree branches.
 	case ENodeType::Singleton:
 		{
-			const auto ExistingBody = MakeClusterNode(Node);
+			uint32 ExistingBodyIndex;
+			const auto ExistingBody = MakeClusterNode(NodeIndex, ExistingBodyIndex);
 
-			const bool bHasInsertedNewBody = InsertInternal(Node, Body);
-			const bool bHasInsertedExistingBody = InsertInternal(Node, ExistingBody);
+			const bool bHasInsertedNewBody = InsertInternal(NodeIndex, NodeBounds, Body, BodyIndex);
+			const bool bHasInsertedExistingBody = InsertInternal(NodeIndex, NodeBounds, ExistingBody, ExistingBodyIndex);
 
 			return bHasInsertedExistingBody && bHasInsertedNewBody;
 		}
@@ -147,30 +394,642 @@ bool TBarnesHutTree<BranchSize>::InsertInternal(TTreeNode<BranchSize>& Node, con
 		return false;
 	}
 }
+
 template<int BranchSize>
-TTreeNode<BranchSize>& TBarnesHutTree<BranchSize>::MakeNewNode(const FQuadrantBounds& Bounds)
+FBodyDescriptor TBarnesHutTree<BranchSize>::MakeClusterNode(const uint32 NodeIndex, uint32& OutExistingBodyIndex)
 {
-	const int Index = InternalNodesArr.Add(TTreeNode<BranchSize>(Bounds));
-	return InternalNodesArr[Index];
+	const uint8 ChildDepth = InternalNodesArr[NodeIndex].Depth + 1;
+	MaxNodeDepth = FMath::Max<int>(MaxNodeDepth, ChildDepth);
+
+	// Children are allocated as one contiguous block, the node only keeps the index of the first one
+	const uint32 FirstChild = InternalNodesArr.Num();
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+		InternalNodesArr.Emplace(ChildDepth);
+
+	// Cleanup and return the existing body to be handled by the caller
+	TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	const FBodyDescriptor ExistingBody = Node.AsBody();
+	OutExistingBodyIndex = Node.BodyIndex;
+
+	Node.NodeType = ENodeType::Cluster;
+	Node.FirstChild = FirstChild;
+	Node.CenterOfMass = FVector2f(0);
+	Node.Mass = 0;
+
+	return ExistingBody;
 }
 
-// @TODO: Cleanup
 template<int BranchSize>
-FBodyDescriptor TBarnesHutTree<BranchSize>::MakeClusterNode(TTreeNode<BranchSize>& Node)
+void TBarnesHutTree<BranchSize>::BuildParallel(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies,
+                                               const int NumWorkers)
 {
-	// Create and insert a new node in the internal array for each quadrant
-	// Then add them to the node as leaves
+	static_assert(BranchSize == ETreeBranchSize::QuadTree, "Parallel tree build only supports quad trees.");
+
+	TreeBounds = WorldBounds;
+	bCanRefit = false;
+
+	const int SplitDepth = GetSplitDepth(NumWorkers);
+	int NumCells = 1;
+	for (int Depth = 0; Depth < SplitDepth; Depth++)
+		NumCells *= BranchSize;
+
+	// Find the cell each body belongs to
+	BodyCells.SetNumUninitialized(Bodies.Num());
+	ParallelFor(Bodies.Num(), [&](const int BodyIndex)
+	{
+		const FVector2f Location = Bodies.GetLocation(BodyIndex);
+		check(WorldBounds.IsWithinBounds(Location));
+
+		FQuadrantBounds Bounds = WorldBounds;
+		int Cell = 0;
+		for (int Depth = 0; Depth < SplitDepth; Depth++)
+		{
+			const EQuadrantLocation QuadLocation = Bounds.GetQuadrantLocation(Location);
+			Cell = Cell * BranchSize + StaticCast<int>(QuadLocation);
+			Bounds = Bounds.GetQuadrantBounds(QuadLocation);
+		}
+		BodyCells[BodyIndex] = Cell;
+	});
+
+	// Counting sort the bodies into their cells, keeping their original order within a cell
+	CellStarts.Init(0, NumCells + 1);
+	for (const int Cell : BodyCells)
+		++CellStarts[Cell + 1];
+	for (int Cell = 0; Cell < NumCells; Cell++)
+		CellStarts[Cell + 1] += CellStarts[Cell];
+
+	TArray<int> CellCursors(CellStarts.GetData(), NumCells);
+	CellBodyIndices.SetNumUninitialized(Bodies.Num());
+	for (int BodyIndex = 0; BodyIndex < Bodies.Num(); BodyIndex++)
+		CellBodyIndices[CellCursors[BodyCells[BodyIndex]]++] = BodyIndex;
+
+	// Each cell is fully owned by one worker, no synchronization needed while building
+	while (SubTrees.Num() < NumCells)
+		SubTrees.Add(TUniquePtr<TBarnesHutTree>(new TBarnesHutTree(MinNodeSize)));
+
+	ParallelFor(NumCells, [&](const int Cell)
+	{
+		TBarnesHutTree& SubTree = *SubTrees[Cell];
+		SubTree.Reset(GetCellBounds(WorldBounds, Cell, SplitDepth), CellStarts[Cell + 1] - CellStarts[Cell]);
+
+		for (int i = CellStarts[Cell]; i < CellStarts[Cell + 1]; i++)
+			SubTree.Insert(Bodies.Get(CellBodyIndices[i]), CellBodyIndices[i]);
+	});
+
+	// Final layout: the levels above the split, then every subtree root so siblings stay contiguous,
+	// then the rest of each subtree in cell order
+	const uint32 NumTopNodes = (NumCells - 1) / (BranchSize - 1);
+	uint32 NumNodes = NumTopNodes + NumCells;
+
+	SubTreeOffsets.SetNumUninitialized(NumCells);
+	for (int Cell = 0; Cell < NumCells; Cell++)
+	{
+		SubTreeOffsets[Cell] = NumNodes;
+		NumNodes += SubTrees[Cell]->NumNodes() - 1;
+	}
+
+	InternalNodesArr.Reset(NumNodes);
+	InternalNodesArr.SetNumUninitialized(NumNodes);
+
+	ParallelFor(NumCells, [&](const int Cell)
+	{
+		const TArray<TTreeNode<BranchSize>>& SubTreeNodes = SubTrees[Cell]->InternalNodesArr;
+		const uint32 Offset = SubTreeOffsets[Cell];
+
+		// Child indices within a subtree are always past its root, shift them to where the subtree is copied to
+		for (int SubTreeIndex = 0; SubTreeIndex < SubTreeNodes.Num(); SubTreeIndex++)
+		{
+			TTreeNode<BranchSize> Node = SubTreeNodes[SubTreeIndex];
+			Node.Depth += SplitDepth;
+			if (Node.IsCluster())
+				Node.FirstChild = Offset + Node.FirstChild - 1;
+
+			const uint32 Destination = SubTreeIndex == 0 ? NumTopNodes + Cell : Offset + SubTreeIndex - 1;
+			InternalNodesArr[Destination] = Node;
+		}
+	});
+
+	MaxNodeDepth = 0;
+	for (int Cell = 0; Cell < NumCells; Cell++)
+		MaxNodeDepth = FMath::Max(MaxNodeDepth, SplitDepth + SubTrees[Cell]->MaxNodeDepth);
+
+	InternalNodesArr[0] = TTreeNode<BranchSize>(StaticCast<uint8>(0));
+	StitchSubTrees(0, 0, SplitDepth, NumTopNodes);
+}
+
+template<int BranchSize>
+FQuadrantBounds TBarnesHutTree<BranchSize>::GetCellBounds(const FQuadrantBounds& WorldBounds, const int Cell,
+                                                          const int SplitDepth)
+{
+	FQuadrantBounds Bounds = WorldBounds;
+	int Divisor = 1;
+	for (int Depth = 1; Depth < SplitDepth; Depth++)
+		Divisor *= BranchSize;
+
+	for (; Divisor > 0; Divisor /= BranchSize)
+		Bounds = Bounds.GetQuadrantBounds((Cell / Divisor) % BranchSize);
+
+	return Bounds;
+}
+
+template<int BranchSize>
+int TBarnesHutTree<BranchSize>::StitchSubTrees(const uint32 NodeIndex, const int CellPrefix, const int SplitDepth,
+                                               const uint32 NumTopNodes)
+{
+	const int Depth = InternalNodesArr[NodeIndex].Depth;
+
+	// Top levels are laid out breadth first, children of the level right above the split are the subtree roots
+	uint32 FirstChild;
+	if (Depth + 1 == SplitDepth)
+	{
+		FirstChild = NumTopNodes + CellPrefix * BranchSize;
+	}
+	else
+	{
+		uint32 LevelStart = 0;
+		uint32 LevelSize = 1;
+		for (int Level = 0; Level <= Depth; Level++)
+		{
+			LevelStart += LevelSize;
+			LevelSize *= BranchSize;
+		}
+		FirstChild = LevelStart + CellPrefix * BranchSize;
+	}
+
+	int ChildNumBodies[BranchSize];
+	int NumBodies = 0;
+
 	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
 	{
-		const FQuadrantBounds Bounds = Node.NodeBounds.GetQuadrantBounds(QuadIndex);
-		TTreeNode<BranchSize>& NewNode = MakeNewNode(Bounds);
-		Node.InsertLeaf(QuadIndex, &NewNode);
+		const int ChildCell = CellPrefix * BranchSize + QuadIndex;
+
+		if (Depth + 1 == SplitDepth)
+		{
+			ChildNumBodies[QuadIndex] = CellStarts[ChildCell + 1] - CellStarts[ChildCell];
+		}
+		else
+		{
+			InternalNodesArr[FirstChild + QuadIndex] = TTreeNode<BranchSize>(StaticCast<uint8>(Depth + 1));
+			ChildNumBodies[QuadIndex] = StitchSubTrees(FirstChild + QuadIndex, ChildCell, SplitDepth, NumTopNodes);
+		}
+
+		NumBodies += ChildNumBodies[QuadIndex];
 	}
 
-	// Cleanup and return the existing body to be handled by the caller
-	Node.NodeType = ENodeType::Cluster;
-	const FBodyDescriptor ExistingBody = Node.BodyDescriptor;
-	Node.BodyDescriptor = FBodyDescriptor();
+	TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
 
-	return ExistingBody;
+	// Mirror the serial path, a region holding a single body is a singleton & the body is copied over as is.
+	if (NumBodies == 1)
+	{
+		for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+		{
+			if (ChildNumBodies[QuadIndex] == 1)
+			{
+				const TTreeNode<BranchSize>& Child = InternalNodesArr[FirstChild + QuadIndex];
+				Node.NodeType = ENodeType::Singleton;
+				Node.CenterOfMass = Child.CenterOfMass;
+				Node.Mass = Child.Mass;
+				Node.BodyIndex = Child.BodyIndex;
+			}
+		}
+	}
+	else if (NumBodies > 1)
+	{
+		Node.NodeType = ENodeType::Cluster;
+		Node.FirstChild = FirstChild;
+		for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+		{
+			const TTreeNode<BranchSize>& Child = InternalNodesArr[FirstChild + QuadIndex];
+			if (!Child.IsEmpty())
+				Node.AccumulateMass(Child);
+		}
+	}
+
+	return NumBodies;
+}
+
+template<int BranchSize>
+void TBarnesHutTree<BranchSize>::BuildConcurrent(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies,
+                                                 const int NumWorkers)
+{
+	static_assert(BranchSize == ETreeBranchSize::QuadTree, "Concurrent tree build only supports quad trees.");
+
+	TreeBounds = WorldBounds;
+	CellBodyIndices.Reset();
+	bCanRefit = false;
+
+	const int NumBodies = Bodies.Num();
+	const int NumTasks = FMath::Clamp(NumWorkers * 4, 1, FMath::Max(NumBodies, 1));
+	const int BodiesPerTask = FMath::DivideAndRoundUp(FMath::Max(NumBodies, 1), NumTasks);
+	TaskMaxDepths.SetNumUninitialized(NumTasks);
+
+	// Nodes can't be appended while workers hold references into the array, so it's sized up front & the whole
+	// insertion is started over with twice as many nodes whenever that wasn't enough. Every task holds on to the
+	// unused end of its last pool chunk, on top of the nodes the bodies need.
+	const uint32 MinCapacity = NumTasks * NodePoolChunkSize + BranchSize * NumBodies + 1;
+	uint32 Capacity = FMath::Max(MinCapacity, ConcurrentNodeCapacity);
+	uint32 NumAllocatedNodes;
+	bool bHasRunOutOfNodes;
+	do
+	{
+		InternalNodesArr.SetNumUninitialized(Capacity);
+		InternalNodesArr[0] = TTreeNode<BranchSize>(StaticCast<uint8>(0));
+
+		std::atomic<uint32> NextFreeNode{1};
+		std::atomic<bool> bRanOutOfNodes{false};
+		ParallelFor(NumTasks, [&](const int Task)
+		{
+			FNodePool Pool;
+			const int End = FMath::Min((Task + 1) * BodiesPerTask, NumBodies);
+			for (int BodyIndex = Task * BodiesPerTask; BodyIndex < End; BodyIndex++)
+			{
+				if (bRanOutOfNodes.load(std::memory_order_relaxed) ||
+					!InsertConcurrent(Bodies.Get(BodyIndex), BodyIndex, Pool, NextFreeNode))
+				{
+					bRanOutOfNodes.store(true, std::memory_order_relaxed);
+					break;
+				}
+			}
+			TaskMaxDepths[Task] = Pool.MaxDepth;
+		});
+
+		NumAllocatedNodes = FMath::Min<uint32>(NextFreeNode.load(), Capacity);
+		bHasRunOutOfNodes = bRanOutOfNodes.load();
+		if (bHasRunOutOfNodes)
+			Capacity *= 2;
+	}
+	while (bHasRunOutOfNodes);
+	ConcurrentNodeCapacity = Capacity;
+
+	MaxNodeDepth = 0;
+	for (const int TaskMaxDepth : TaskMaxDepths)
+		MaxNodeDepth = FMath::Max(MaxNodeDepth, TaskMaxDepth);
+
+	// Masses bottom-up, every split root's subtree on its own worker, then the few levels above them
+	const int SplitDepth = GetSplitDepth(NumWorkers);
+	SplitRoots.Reset();
+	CollectSplitRoots(0, TreeBounds, SplitDepth);
+
+	ParallelFor(SplitRoots.Num(), [&](const int RootIndex)
+	{
+		UpdateClusterMass(SplitRoots[RootIndex].Key, MAX_int32);
+	});
+	UpdateClusterMass(0, SplitDepth);
+
+	// Pools leave child blocks in whatever order workers got to them, with unused nodes at the end of every chunk.
+	// Walks & moments rely on children coming after their parent, so the nodes are copied out again depth first:
+	// the levels above the split roots, then every split root's descendants in a range of their own.
+	// Never shrunk, it's swapped in as the internal array & grown back to the full capacity on the next build
+	RelayoutNodes.SetNumUninitialized(NumAllocatedNodes, false);
+	RelayoutNodes[0] = InternalNodesArr[0];
+
+	uint32 NumTopNodes = 1;
+	SplitRootDestinations.Reset(SplitRoots.Num());
+	RelayoutTopLevels(0, 0, NumTopNodes, SplitDepth);
+	check(SplitRootDestinations.Num() == SplitRoots.Num());
+
+	SplitRootOffsets.SetNumUninitialized(SplitRoots.Num() + 1);
+	SplitRootOffsets[0] = NumTopNodes;
+	ParallelFor(SplitRoots.Num(), [&](const int RootIndex)
+	{
+		SplitRootOffsets[RootIndex + 1] = CountDescendants(SplitRoots[RootIndex].Key);
+	});
+	for (int RootIndex = 0; RootIndex < SplitRoots.Num(); RootIndex++)
+		SplitRootOffsets[RootIndex + 1] += SplitRootOffsets[RootIndex];
+
+	ParallelFor(SplitRoots.Num(), [&](const int RootIndex)
+	{
+		RelayoutDescendants(SplitRoots[RootIndex].Key, SplitRootDestinations[RootIndex], SplitRootOffsets[RootIndex]);
+	});
+
+	RelayoutNodes.SetNum(SplitRootOffsets.Last(), false);
+	Swap(InternalNodesArr, RelayoutNodes);
+}
+
+template<int BranchSize>
+bool TBarnesHutTree<BranchSize>::InsertConcurrent(const FBodyDescriptor& Body, const uint32 BodyIndex,
+                                                  FNodePool& Pool, std::atomic<uint32>& NextFreeNode)
+{
+	check(TreeBounds.IsWithinBounds(Body.Location));
+
+	uint32 NodeIndex = 0;
+	FQuadrantBounds NodeBounds = TreeBounds;
+	while (true)
+	{
+		TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+		std::atomic<ENodeType>& AtomicNodeType = Node.GetAtomicNodeType();
+
+		// Acquire pairs with the release publishing the node, so its body or children are visible once its type is
+		ENodeType NodeType = AtomicNodeType.load(std::memory_order_acquire);
+		switch (NodeType)
+		{
+		case ENodeType::Cluster:
+			{
+				const EQuadrantLocation QuadLocation = NodeBounds.GetQuadrantLocation(Body.Location);
+				check(QuadLocation < EQuadrantLocation::Outside);
+
+				NodeIndex = Node.GetChildIndex(QuadLocation);
+				NodeBounds = NodeBounds.GetQuadrantBounds(QuadLocation);
+				break;
+			}
+
+		case ENodeType::Empty:
+			{
+				if (!AtomicNodeType.compare_exchange_weak(NodeType, ENodeType::Locked, std::memory_order_acquire,
+				                                          std::memory_order_relaxed))
+					break;
+
+				Node.SetBody(Body, BodyIndex);
+				AtomicNodeType.store(ENodeType::Singleton, std::memory_order_release);
+				return true;
+			}
+
+		case ENodeType::Singleton:
+			{
+				if (!AtomicNodeType.compare_exchange_weak(NodeType, ENodeType::Locked, std::memory_order_acquire,
+				                                          std::memory_order_relaxed))
+					break;
+
+				// Same cutoff as the serial path, bodies this close are folded into one pseudo body with no index
+				if (NodeBounds.Length() <= MinNodeSize)
+				{
+					Node.AccumulateMass(Body);
+					Node.BodyIndex = TTreeNode<BranchSize>::InvalidBodyIndex;
+					AtomicNodeType.store(ENodeType::Singleton, std::memory_order_release);
+					return true;
+				}
+
+				if (Pool.Next == Pool.End)
+				{
+					const uint32 ChunkStart = NextFreeNode.fetch_add(NodePoolChunkSize, std::memory_order_relaxed);
+					if (ChunkStart + NodePoolChunkSize > StaticCast<uint32>(InternalNodesArr.Num()))
+					{
+						AtomicNodeType.store(ENodeType::Singleton, std::memory_order_release);
+						return false;
+					}
+					Pool.Next = ChunkStart;
+					Pool.End = ChunkStart + NodePoolChunkSize;
+				}
+
+				const uint32 FirstChild = Pool.Next;
+				Pool.Next += BranchSize;
+
+				const uint8 ChildDepth = Node.Depth + 1;
+				Pool.MaxDepth = FMath::Max<int>(Pool.MaxDepth, ChildDepth);
+				for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+					InternalNodesArr[FirstChild + QuadIndex] = TTreeNode<BranchSize>(ChildDepth);
+
+				// The existing body moves straight down to its child, the new one goes on through the cluster below
+				const EQuadrantLocation ExistingLocation = NodeBounds.GetQuadrantLocation(Node.CenterOfMass);
+				TTreeNode<BranchSize>& ExistingLeaf = InternalNodesArr[FirstChild + StaticCast<int>(ExistingLocation)];
+				ExistingLeaf.SetBody(Node.AsBody(), Node.BodyIndex);
+				ExistingLeaf.NodeType = ENodeType::Singleton;
+
+				Node.FirstChild = FirstChild;
+				AtomicNodeType.store(ENodeType::Cluster, std::memory_order_release);
+				break;
+			}
+
+		case ENodeType::Locked:
+			FPlatformProcess::Yield();
+			break;
+
+		default:
+			return false;
+		}
+	}
+}
+
+template<int BranchSize>
+uint32 TBarnesHutTree<BranchSize>::CopyChildBlock(const uint32 NodeIndex, const uint32 Destination,
+                                                  const uint32 Cursor)
+{
+	const uint32 FirstChild = InternalNodesArr[NodeIndex].FirstChild;
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+		RelayoutNodes[Cursor + QuadIndex] = InternalNodesArr[FirstChild + QuadIndex];
+
+	RelayoutNodes[Destination].FirstChild = Cursor;
+	return Cursor + BranchSize;
+}
+
+template<int BranchSize>
+void TBarnesHutTree<BranchSize>::RelayoutTopLevels(const uint32 NodeIndex, const uint32 Destination, uint32& Cursor,
+                                                   const int SplitDepth)
+{
+	const TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	if (!Node.IsCluster() || Node.Depth >= SplitDepth)
+	{
+		SplitRootDestinations.Add(Destination);
+		return;
+	}
+
+	const uint32 FirstChild = Cursor;
+	Cursor = CopyChildBlock(NodeIndex, Destination, Cursor);
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+	{
+		RelayoutTopLevels(Node.FirstChild + QuadIndex, FirstChild + QuadIndex, Cursor, SplitDepth);
+	}
+}
+
+template<int BranchSize>
+uint32 TBarnesHutTree<BranchSize>::RelayoutDescendants(const uint32 NodeIndex, const uint32 Destination,
+                                                       uint32 Cursor)
+{
+	const TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	if (!Node.IsCluster())
+		return Cursor;
+
+	const uint32 FirstChild = Cursor;
+	Cursor = CopyChildBlock(NodeIndex, Destination, Cursor);
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+	{
+		Cursor = RelayoutDescendants(Node.FirstChild + QuadIndex, FirstChild + QuadIndex, Cursor);
+	}
+	return Cursor;
+}
+
+template<int BranchSize>
+int TBarnesHutTree<BranchSize>::CountDescendants(const uint32 NodeIndex) const
+{
+	const TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	if (!Node.IsCluster())
+		return 0;
+
+	int NumDescendants = BranchSize;
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+	{
+		NumDescendants += CountDescendants(Node.FirstChild + QuadIndex);
+	}
+	return NumDescendants;
+}
+
+template<int BranchSize>
+void TBarnesHutTree<BranchSize>::TrackBodyLeaves(const int NumBodies, const int NumWorkers)
+{
+	bCanRefit = false;
+	NumReinsertedBodies = 0;
+	BodyLeafNodes.SetNumUninitialized(NumBodies);
+	BodyLeafBounds.SetNumUninitialized(NumBodies);
+
+	SplitRoots.Reset();
+	CollectSplitRoots(0, TreeBounds, GetSplitDepth(NumWorkers));
+
+	std::atomic<int> NumTracked{0};
+	ParallelFor(SplitRoots.Num(), [&](const int RootIndex)
+	{
+		const int NumRootTracked = TrackLeavesBelow(SplitRoots[RootIndex].Key, SplitRoots[RootIndex].Value);
+		NumTracked.fetch_add(NumRootTracked, std::memory_order_relaxed);
+	});
+
+	// Folded bodies have no leaf of their own, such trees can only be rebuilt
+	bCanRefit = NumTracked.load() == NumBodies;
+}
+
+template<int BranchSize>
+bool TBarnesHutTree<BranchSize>::Refit(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies,
+                                       const int NumWorkers, const float MaxReinsertedFraction)
+{
+	const int NumBodies = Bodies.Num();
+	if (!bCanRefit || NumBodies != BodyLeafNodes.Num() || WorldBounds.Vec != TreeBounds.Vec)
+		return false;
+
+	// Bodies still within their leaf are the only ones there, so the leaf simply follows them
+	BodyLeftLeaf.SetNumUninitialized(NumBodies);
+	ParallelFor(NumBodies, [&](const int BodyIndex)
+	{
+		const FVector4f& Bounds = BodyLeafBounds[BodyIndex];
+		const FQuadrantBounds LeafBounds(Bounds.X, Bounds.Y, Bounds.Z, Bounds.W);
+		const FVector2f Location = Bodies.GetLocation(BodyIndex);
+
+		BodyLeftLeaf[BodyIndex] = !LeafBounds.IsWithinBounds(Location);
+		if (!BodyLeftLeaf[BodyIndex])
+			InternalNodesArr[BodyLeafNodes[BodyIndex]].SetBody(Bodies.Get(BodyIndex), BodyIndex);
+	});
+
+	LeftLeafBodies.Reset();
+	for (int BodyIndex = 0; BodyIndex < NumBodies; BodyIndex++)
+	{
+		if (BodyLeftLeaf[BodyIndex])
+			LeftLeafBodies.Add(BodyIndex);
+	}
+
+	NumReinsertedBodies += LeftLeafBodies.Num();
+	if (NumReinsertedBodies > MaxReinsertedFraction * NumBodies)
+	{
+		bCanRefit = false;
+		return false;
+	}
+
+	// Empty every leaf first, so no body is pushed down from a leaf it already left
+	for (const uint32 BodyIndex : LeftLeafBodies)
+	{
+		TTreeNode<BranchSize>& Leaf = InternalNodesArr[BodyLeafNodes[BodyIndex]];
+		Leaf.NodeType = ENodeType::Empty;
+		Leaf.CenterOfMass = FVector2f(0);
+		Leaf.Mass = 0;
+	}
+
+	// Clusters on the way accumulate stale masses here, they're all recomputed below
+	bHasFoldedBodies = false;
+	for (const uint32 BodyIndex : LeftLeafBodies)
+		InsertInternal(0, TreeBounds, Bodies.Get(BodyIndex), BodyIndex);
+
+	if (bHasFoldedBodies)
+	{
+		bCanRefit = false;
+		return false;
+	}
+
+	// Insertions may have split leaves above the split depth, so the roots are gathered again every refit
+	const int SplitDepth = GetSplitDepth(NumWorkers);
+	SplitRoots.Reset();
+	CollectSplitRoots(0, TreeBounds, SplitDepth);
+
+	ParallelFor(SplitRoots.Num(), [&](const int RootIndex)
+	{
+		UpdateClusterMass(SplitRoots[RootIndex].Key, MAX_int32);
+	});
+	UpdateClusterMass(0, SplitDepth);
+
+	return true;
+}
+
+template<int BranchSize>
+int TBarnesHutTree<BranchSize>::GetSplitDepth(const int NumWorkers)
+{
+	// Oversubscribe the workers so clustered distributions still spread out somewhat evenly
+	int SplitDepth = 1;
+	int NumCells = BranchSize;
+	while (NumCells < NumWorkers * 4 && SplitDepth < MaxSplitDepth)
+	{
+		++SplitDepth;
+		NumCells *= BranchSize;
+	}
+	return SplitDepth;
+}
+
+template<int BranchSize>
+void TBarnesHutTree<BranchSize>::CollectSplitRoots(const uint32 NodeIndex, const FQuadrantBounds& NodeBounds,
+                                                   const int SplitDepth)
+{
+	const TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	if (!Node.IsCluster() || Node.Depth >= SplitDepth)
+	{
+		SplitRoots.Emplace(NodeIndex, NodeBounds);
+		return;
+	}
+
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+	{
+		CollectSplitRoots(Node.FirstChild + QuadIndex, NodeBounds.GetQuadrantBounds(QuadIndex), SplitDepth);
+	}
+}
+
+template<int BranchSize>
+int TBarnesHutTree<BranchSize>::TrackLeavesBelow(const uint32 NodeIndex, const FQuadrantBounds& NodeBounds)
+{
+	const TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	if (Node.IsSingleton() && Node.BodyIndex != TTreeNode<BranchSize>::InvalidBodyIndex)
+	{
+		BodyLeafNodes[Node.BodyIndex] = NodeIndex;
+		BodyLeafBounds[Node.BodyIndex] = NodeBounds.Vec;
+		return 1;
+	}
+
+	// Bodies folded into a minimum size cluster never reach its children, nor have a singleton of their own when
+	// folded by a concurrent build
+	if (!Node.IsCluster())
+		return 0;
+
+	int NumTracked = 0;
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+	{
+		NumTracked += TrackLeavesBelow(Node.FirstChild + QuadIndex, NodeBounds.GetQuadrantBounds(QuadIndex));
+	}
+	return NumTracked;
+}
+
+template<int BranchSize>
+void TBarnesHutTree<BranchSize>::UpdateClusterMass(const uint32 NodeIndex, const int StopDepth)
+{
+	TTreeNode<BranchSize>& Node = InternalNodesArr[NodeIndex];
+	if (!Node.IsCluster())
+		return;
+
+	Node.CenterOfMass = FVector2f(0);
+	Node.Mass = 0;
+	for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+	{
+		const uint32 ChildIndex = Node.FirstChild + QuadIndex;
+		if (InternalNodesArr[ChildIndex].Depth < StopDepth)
+			UpdateClusterMass(ChildIndex, StopDepth);
+
+		const TTreeNode<BranchSize>& Child = InternalNodesArr[ChildIndex];
+		if (!Child.IsEmpty())
+			Node.AccumulateMass(Child);
+	}
+
+	// Every body below left, its children stay allocated until the next full build
+	if (Node.Mass == 0)
+		Node.NodeType = ENodeType::Empty;
 }
@@ -0,0 +1,163 @@
+#pragma once
+#include "BodyDescriptor.h"
+#include "QuadrantBounds.h"
+#include "MemoryFootprint.h"
+
+/**
+ * @brief Structure of arrays body storage.
+ * Every field of FBodyDescriptor lives in its own contiguous stream, so passes that only touch locations or
+ * velocities don't drag the cold fields through the cache, and the streaming passes below can be vectorized.
+ * FBodyDescriptor stays the interchange format for single bodies (Blueprints, trees, debug drawing).
+ */
+struct FBodyArray
+{
+	// 32 byte aligned so the streams can be loaded with full width vector loads
+	typedef TArray<float, TAlignedHeapAllocator<32>> FStream;
+
+	FStream X;
+	FStream Y;
+	FStream VX;
+	FStream VY;
+	FStream Mass;
+	// Calculation cost, value used for threading
+	FStream Cost;
+	// Block time step of every body, 2^Level ticks long, see FBlockTimeStepper
+	TArray<uint8> TimeStepLevel;
+
+	FORCEINLINE int Num() const { return X.Num(); }
+
+	FORCEINLINE bool IsValidIndex(const int Index) const { return X.IsValidIndex(Index); }
+
+	void Reserve(const int NumBodies)
+	{
+		X.Reserve(NumBodies);
+		Y.Reserve(NumBodies);
+		VX.Reserve(NumBodies);
+		VY.Reserve(NumBodies);
+		Mass.Reserve(NumBodies);
+		Cost.Reserve(NumBodies);
+		TimeStepLevel.Reserve(NumBodies);
+	}
+
+	void Reset()
+	{
+		X.Reset();
+		Y.Reset();
+		VX.Reset();
+		VY.Reset();
+		Mass.Reset();
+		Cost.Reset();
+		TimeStepLevel.Reset();
+	}
+
+	int Add(const FBodyDescriptor& Body)
+	{
+		VX.Add(Body.Velocity.X);
+		VY.Add(Body.Velocity.Y);
+		Mass.Add(Body.Mass);
+		Cost.Add(Body.SimCost);
+		TimeStepLevel.Add(0);
+		Y.Add(Body.Location.Y);
+		return X.Add(Body.Location.X);
+	}
+
+	/**
+	 * @brief Appends NumBodies zeroed bodies, at rest, massless & at the origin, for passes to fill in.
+	 * @return Index of the first appended body
+	 */
+	int AddZeroed(const int NumBodies)
+	{
+		VX.AddZeroed(NumBodies);
+		VY.AddZeroed(NumBodies);
+		Mass.AddZeroed(NumBodies);
+		Cost.AddZeroed(NumBodies);
+		TimeStepLevel.AddZeroed(NumBodies);
+		Y.AddZeroed(NumBodies);
+		return X.AddZeroed(NumBodies);
+	}
+
+	FORCEINLINE FVector2f GetLocation(const int Index) const { return FVector2f(X[Index], Y[Index]); }
+
+	FORCEINLINE FVector2f GetVelocity(const int Index) const { return FVector2f(VX[Index], VY[Index]); }
+
+	FORCEINLINE void SetVelocity(const int Index, const FVector2f Velocity)
+	{
+		VX[Index] = Velocity.X;
+		VY[Index] = Velocity.Y;
+	}
+
+	FORCEINLINE FBodyDescriptor Get(const int Index) const
+	{
+		FBodyDescriptor Body(GetLocation(Index), Mass[Index]);
+		Body.Velocity = GetVelocity(Index);
+		Body.SimCost = Cost[Index];
+		return Body;
+	}
+
+	FORCEINLINE FBodyDescriptor operator[](const int Index) const { return Get(Index); }
+
+	FORCEINLINE void Set(const int Index, const FBodyDescriptor& Body)
+	{
+		X[Index] = Body.Location.X;
+		Y[Index] = Body.Location.Y;
+		VX[Index] = Body.Velocity.X;
+		VY[Index] = Body.Velocity.Y;
+		Mass[Index] = Body.Mass;
+		Cost[Index] = Body.SimCost;
+	}
+
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(X);
+		Footprint.Add(Y);
+		Footprint.Add(VX);
+		Footprint.Add(VY);
+		Footprint.Add(Mass);
+		Footprint.Add(Cost);
+		Footprint.Add(TimeStepLevel);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Streaming version of FBodyDescriptor::WarpWithinBounds over every body.
+	 */
+	void WarpWithinBounds(const FQuadrantBounds& Bounds)
+	{
+		WarpStream(X, Bounds.Left, Bounds.Right);
+		WarpStream(Y, Bounds.Top, Bounds.Bottom);
+	}
+
+	/**
+	 * @brief Moves every body along its velocity.
+	 */
+	void Integrate(const float DeltaTime)
+	{
+		const int NumBodies = Num();
+		float* RESTRICT XData = X.GetData();
+		float* RESTRICT YData = Y.GetData();
+		const float* RESTRICT VXData = VX.GetData();
+		const float* RESTRICT VYData = VY.GetData();
+
+		for (int i = 0; i < NumBodies; i++)
+		{
+			XData[i] += VXData[i] * DeltaTime;
+			YData[i] += VYData[i] * DeltaTime;
+		}
+	}
+
+private:
+	static void WarpStream(FStream& Stream, const float Min, const float Max)
+	{
+		// Branchless so the loop vectorizes, same wrapping as FBodyDescriptor::WarpWithinBounds
+		const float Size = FMath::Abs(Max - Min);
+		const int NumBodies = Stream.Num();
+		float* RESTRICT Data = Stream.GetData();
+
+		for (int i = 0; i < NumBodies; i++)
+		{
+			const float Value = Data[i];
+			Data[i] = Value < Min ? Value + Size : (Value > Max ? Value - Size : Value);
+		}
+	}
+};
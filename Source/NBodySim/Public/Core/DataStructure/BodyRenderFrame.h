@@ -0,0 +1,82 @@
+#pragma once
+#include "BodyArray.h"
+#include "MemoryFootprint.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * @brief What the renderer needs from every body for one frame, packed as floats in stable index order.
+ * Every body is (X, Y): Location & (Z): Mass, 12 bytes against the 24 of an FVector, & is read in place by the Niagara
+ * data interface, so packing the frame is the only copy the body data goes through on its way to the particles.
+ */
+class FBodyRenderFrame
+{
+	TArray<FVector3f> PackedBodies;
+
+	// Bodies per packing task, small chunks would cost more to schedule than to pack
+	static constexpr int PackChunkSize = 16384;
+
+public:
+	FORCEINLINE int Num() const { return PackedBodies.Num(); }
+
+	/**
+	 * @brief Every body as (X, Y): Location & (Z): Mass, in stable index order.
+	 */
+	FORCEINLINE TArrayView<const FVector3f> GetPackedBodies() const { return PackedBodies; }
+
+	/**
+	 * @brief Reads the body with the given stable index.
+	 * @return False, leaving the outputs untouched, if there's no such body in this frame
+	 */
+	FORCEINLINE bool GetBody(const int StableIndex, FVector2f& OutLocation, float& OutMass) const
+	{
+		if (!PackedBodies.IsValidIndex(StableIndex))
+			return false;
+
+		const FVector3f& Body = PackedBodies[StableIndex];
+		OutLocation = FVector2f(Body.X, Body.Y);
+		OutMass = Body.Z;
+		return true;
+	}
+
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(PackedBodies);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Packs every body's location & mass, reusing the frame's allocation.
+	 * @param Bodies Bodies to pack
+	 * @param StableIndices Stable index of every body in storage order, storage order is kept if empty
+	 */
+	void Pack(const FBodyArray& Bodies, const TArrayView<const uint32> StableIndices)
+	{
+		const int NumBodies = Bodies.Num();
+		check(StableIndices.Num() == 0 || StableIndices.Num() == NumBodies);
+		PackedBodies.SetNumUninitialized(NumBodies);
+
+		const int NumChunks = FMath::DivideAndRoundUp(NumBodies, PackChunkSize);
+		ParallelFor(NumChunks, [&](const int Chunk)
+		{
+			const float* RESTRICT XData = Bodies.X.GetData();
+			const float* RESTRICT YData = Bodies.Y.GetData();
+			const float* RESTRICT MassData = Bodies.Mass.GetData();
+			FVector3f* RESTRICT PackedData = PackedBodies.GetData();
+			const int ChunkEnd = FMath::Min(NumBodies, (Chunk + 1) * PackChunkSize);
+
+			if (StableIndices.Num() == 0)
+			{
+				for (int i = Chunk * PackChunkSize; i < ChunkEnd; i++)
+					PackedData[i] = FVector3f(XData[i], YData[i], MassData[i]);
+			}
+			else
+			{
+				// Stable indices are a permutation, so chunks never write the same body
+				const uint32* RESTRICT StableData = StableIndices.GetData();
+				for (int i = Chunk * PackChunkSize; i < ChunkEnd; i++)
+					PackedData[StableData[i]] = FVector3f(XData[i], YData[i], MassData[i]);
+			}
+		});
+	}
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include "BodyArray.h"
+
+/**
+ * @brief Flat list of the (pseudo) bodies a single body interacts with, gathered by walking the tree once.
+ * Kept in the same aligned stream layout as FBodyArray so FForceKernel can evaluate it with full width loads.
+ * Lists are meant to be owned by one worker and reused between bodies, Reset keeps the allocations around.
+ */
+struct FInteractionList
+{
+	FBodyArray::FStream X;
+	FBodyArray::FStream Y;
+	FBodyArray::FStream Mass;
+
+	FORCEINLINE int Num() const { return X.Num(); }
+
+	FORCEINLINE void Reset()
+	{
+		X.Reset();
+		Y.Reset();
+		Mass.Reset();
+	}
+
+	FORCEINLINE void Add(const FVector2f Location, const float InMass)
+	{
+		X.Add(Location.X);
+		Y.Add(Location.Y);
+		Mass.Add(InMass);
+	}
+
+	FORCEINLINE void Add(const FBodyDescriptor& Body)
+	{
+		Add(Body.Location, Body.Mass);
+	}
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include "TreeNode.h"
+#include "BodyArray.h"
+#include "MortonCode.h"
+#include "RadixSort.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * @brief Quad tree built from radix sorted Morton keys into one flat array.
+ * Every node covers a contiguous range of the sorted bodies, so nodes are emitted level by level by splitting ranges
+ * on the key digits of that level, and masses are accumulated bottom-up once all levels exist.
+ * No insertion, no quadrant tests, and every step runs in parallel.
+ * Leaves are buckets of up to LeafCapacity bodies, copied into leaf streams in sorted order so a bucket's bodies are
+ * contiguous. Uses the same TTreeNode layout as TBarnesHutTree so both can be walked by the same force pass.
+ */
+template<int BranchSize>
+class TLinearQuadTree
+{
+	static_assert(BranchSize == ETreeBranchSize::QuadTree, "Morton keys can only describe quad trees.");
+
+private:
+	struct FLinearNode
+	{
+		// Range of sorted bodies covered by this node
+		int First;
+		int End;
+
+		// Index of the first of BranchSize contiguous children, INDEX_NONE for leaves
+		int FirstChild;
+
+		int Level;
+	};
+
+	// Sorted keys & the body each key belongs to
+	TArray<uint32> Keys;
+	TArray<uint32> BodyIndices;
+	FRadixSort RadixSort;
+
+	TArray<FLinearNode> LinearNodes;
+	// Index of the first node of every level, plus one past the last node
+	TArray<int> LevelStarts;
+
+	TArray<TTreeNode<BranchSize>> InternalNodesArr;
+
+	// Bodies in sorted order, every bucket owns a contiguous range starting at its FirstBody
+	FBodyArray::FStream LeafX;
+	FBodyArray::FStream LeafY;
+	FBodyArray::FStream LeafMass;
+
+	// Every non empty bucket, in Morton order
+	TArray<uint32> LeafNodeIndices;
+
+	FQuadrantBounds TreeBounds;
+
+	// Nodes holding more bodies than this are split, unless they're already at MaxDepth
+	int LeafCapacity = 1;
+
+	// Same role as TBarnesHutTree::MinNodeSize, nodes this size or smaller are never split
+	const float MinNodeSize;
+	int MaxDepth = 0;
+
+public:
+	/**
+	 * @param WorldBounds World bounds to start the tree with
+	 * @param NumElements The amount of elements this tree expects to hold
+	 */
+	TLinearQuadTree(const FQuadrantBounds WorldBounds, const int NumElements) :
+		MinNodeSize(WorldBounds.HorizontalSize() * 0.00005)
+	{
+		Reset(WorldBounds, NumElements);
+	}
+
+	FORCEINLINE TTreeNode<BranchSize>& GetRootNode() { return InternalNodesArr[0]; }
+
+	FORCEINLINE int NumNodes() const { return InternalNodesArr.Num(); }
+
+	/**
+	 * @brief Depth of the deepest level, the root being at depth 0.
+	 */
+	FORCEINLINE int GetDepth() const { return FMath::Max(LevelStarts.Num() - 2, 0); }
+
+	FORCEINLINE TTreeView<BranchSize> GetView() const
+	{
+		TTreeView<BranchSize> View(InternalNodesArr.GetData(), TreeBounds);
+		View.LeafX = LeafX.GetData();
+		View.LeafY = LeafY.GetData();
+		View.LeafMass = LeafMass.GetData();
+		View.LeafBodyIndices = BodyIndices.GetData();
+		return View;
+	}
+
+	/**
+	 * @brief Indices of every non empty bucket, in Morton order so consecutive buckets are spatially close.
+	 */
+	FORCEINLINE TArrayView<const uint32> GetLeafNodeIndices() const { return LeafNodeIndices; }
+
+	/**
+	 * @brief Every body index in Morton order.
+	 */
+	FORCEINLINE TArrayView<const uint32> GetSortedBodyIndices() const { return BodyIndices; }
+
+	/**
+	 * @brief Memory held by the nodes, leaf streams & sort scratch.
+	 */
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(Keys);
+		Footprint.Add(BodyIndices);
+		Footprint += RadixSort.GetMemoryFootprint();
+		Footprint.Add(LinearNodes);
+		Footprint.Add(LevelStarts);
+		Footprint.Add(InternalNodesArr);
+		Footprint.Add(LeafX);
+		Footprint.Add(LeafY);
+		Footprint.Add(LeafMass);
+		Footprint.Add(LeafNodeIndices);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Sets the maximum number of bodies a leaf holds, applied on the next build.
+	 */
+	FORCEINLINE void SetLeafCapacity(const int Capacity) { LeafCapacity = FMath::Clamp(Capacity, 1, MAX_uint16); }
+
+	void Reset(const FQuadrantBounds WorldBounds, const int NumElements)
+	{
+		TreeBounds = WorldBounds;
+		Keys.Reset(NumElements);
+		BodyIndices.Reset(NumElements);
+		LeafNodeIndices.Reset();
+		InternalNodesArr.Reset(BranchSize * NumElements + 1);
+		InternalNodesArr.Emplace(StaticCast<uint8>(0));
+
+		MaxDepth = 0;
+		for (float Length = WorldBounds.Length(); Length > MinNodeSize && MaxDepth < FMortonCode::BitsPerAxis; Length *= 0.5f)
+			++MaxDepth;
+	}
+
+	/**
+	 * @brief Rebuilds the tree from scratch.
+	 * @param WorldBounds World bounds to build the tree in
+	 * @param Bodies The bodies to build the tree from
+	 * @param NumWorkers Number of workers to split the radix sort passes across
+	 */
+	void Build(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies, const int NumWorkers);
+
+private:
+	void EmitNodes();
+	void AccumulateMasses();
+};
+
+template<int BranchSize>
+void TLinearQuadTree<BranchSize>::Build(const FQuadrantBounds WorldBounds, const FBodyArray& Bodies,
+                                        const int NumWorkers)
+{
+	Reset(WorldBounds, Bodies.Num());
+	if (Bodies.Num() == 0)
+		return;
+
+	Keys.SetNumUninitialized(Bodies.Num());
+	BodyIndices.SetNumUninitialized(Bodies.Num());
+	ParallelFor(Bodies.Num(), [&](const int BodyIndex)
+	{
+		Keys[BodyIndex] = FMortonCode::FromLocation(Bodies.GetLocation(BodyIndex), TreeBounds);
+		BodyIndices[BodyIndex] = BodyIndex;
+	});
+
+	RadixSort.Sort(Keys, BodyIndices, NumWorkers);
+
+	LeafX.SetNumUninitialized(Bodies.Num());
+	LeafY.SetNumUninitialized(Bodies.Num());
+	LeafMass.SetNumUninitialized(Bodies.Num());
+	ParallelFor(Bodies.Num(), [&](const int SortedIndex)
+	{
+		const uint32 BodyIndex = BodyIndices[SortedIndex];
+		LeafX[SortedIndex] = Bodies.X[BodyIndex];
+		LeafY[SortedIndex] = Bodies.Y[BodyIndex];
+		LeafMass[SortedIndex] = Bodies.Mass[BodyIndex];
+	});
+
+	EmitNodes();
+	AccumulateMasses();
+
+	for (int NodeIndex = 0; NodeIndex < InternalNodesArr.Num(); NodeIndex++)
+	{
+		if (InternalNodesArr[NodeIndex].IsBucket())
+			LeafNodeIndices.Add(NodeIndex);
+	}
+
+	// Buckets own disjoint ranges of the sorted bodies, ordering them by range start gives Morton order
+	LeafNodeIndices.Sort([this](const uint32 A, const uint32 B)
+	{
+		return InternalNodesArr[A].FirstBody < InternalNodesArr[B].FirstBody;
+	});
+}
+
+template<int BranchSize>
+void TLinearQuadTree<BranchSize>::EmitNodes()
+{
+	LinearNodes.Reset(BranchSize * Keys.Num() + 1);
+	LinearNodes.Add({0, Keys.Num(), INDEX_NONE, 0});
+
+	LevelStarts.Reset();
+	LevelStarts.Add(0);
+
+	TArray<int> FirstChildIndices;
+	for (int Level = 0; Level < MaxDepth; Level++)
+	{
+		const int LevelStart = LevelStarts.Last();
+		const int LevelEnd = LinearNodes.Num();
+
+		// Every node covering more than LeafCapacity bodies is split, children are placed in the order of their parents
+		FirstChildIndices.SetNumUninitialized(LevelEnd - LevelStart);
+		int NumChildren = 0;
+		for (int NodeIndex = LevelStart; NodeIndex < LevelEnd; NodeIndex++)
+		{
+			const FLinearNode& Node = LinearNodes[NodeIndex];
+			if (Node.End - Node.First > LeafCapacity)
+			{
+				FirstChildIndices[NodeIndex - LevelStart] = LevelEnd + NumChildren;
+				NumChildren += BranchSize;
+			}
+			else
+			{
+				FirstChildIndices[NodeIndex - LevelStart] = INDEX_NONE;
+			}
+		}
+
+		LevelStarts.Add(LevelEnd);
+		if (NumChildren == 0)
+			break;
+
+		LinearNodes.AddUninitialized(NumChildren);
+		ParallelFor(LevelEnd - LevelStart, [&](const int LevelIndex)
+		{
+			FLinearNode& Node = LinearNodes[LevelStart + LevelIndex];
+			Node.FirstChild = FirstChildIndices[LevelIndex];
+			if (Node.FirstChild == INDEX_NONE)
+				return;
+
+			// Keys within a node share every digit above this level, so this level's digit is sorted within the range
+			int ChildFirst = Node.First;
+			for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+			{
+				int Low = ChildFirst;
+				int High = Node.End;
+				while (Low < High)
+				{
+					const int Mid = (Low + High) / 2;
+					if (FMortonCode::GetQuadrantDigit(Keys[Mid], Level) <= StaticCast<uint32>(QuadIndex))
+						Low = Mid + 1;
+					else
+						High = Mid;
+				}
+
+				LinearNodes[Node.FirstChild + QuadIndex] = {ChildFirst, Low, INDEX_NONE, Level + 1};
+				ChildFirst = Low;
+			}
+		});
+	}
+
+	if (LevelStarts.Last() != LinearNodes.Num())
+		LevelStarts.Add(LinearNodes.Num());
+}
+
+template<int BranchSize>
+void TLinearQuadTree<BranchSize>::AccumulateMasses()
+{
+	// Children are always placed right after their parent's level, in the same order as their parents
+	InternalNodesArr.Reset(LinearNodes.Num());
+	InternalNodesArr.SetNumUninitialized(LinearNodes.Num());
+
+	// Bottom-up, every level only reads from the level below it
+	for (int Level = LevelStarts.Num() - 2; Level >= 0; Level--)
+	{
+		const int LevelStart = LevelStarts[Level];
+		ParallelFor(LevelStarts[Level + 1] - LevelStart, [&](const int LevelIndex)
+		{
+			const FLinearNode& LinearNode = LinearNodes[LevelStart + LevelIndex];
+			TTreeNode<BranchSize>& Node = InternalNodesArr[LevelStart + LevelIndex];
+			Node = TTreeNode<BranchSize>(StaticCast<uint8>(LinearNode.Level));
+
+			if (LinearNode.First == LinearNode.End)
+				return;
+
+			if (LinearNode.FirstChild == INDEX_NONE)
+			{
+				// Leaves at MaxDepth can go over capacity, they still fit in a bucket
+				check(LinearNode.End - LinearNode.First <= MAX_uint16);
+
+				Node.NodeType = ENodeType::Bucket;
+				Node.FirstBody = LinearNode.First;
+				Node.NumBodies = LinearNode.End - LinearNode.First;
+				for (int LeafBody = LinearNode.First; LeafBody < LinearNode.End; LeafBody++)
+					Node.AccumulateMass(FVector2f(LeafX[LeafBody], LeafY[LeafBody]), LeafMass[LeafBody]);
+				return;
+			}
+
+			Node.NodeType = ENodeType::Cluster;
+			Node.FirstChild = LinearNode.FirstChild;
+			for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+			{
+				const TTreeNode<BranchSize>& Child = InternalNodesArr[LinearNode.FirstChild + QuadIndex];
+				if (!Child.IsEmpty())
+					Node.AccumulateMass(Child);
+			}
+		});
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/**
+ * @brief Heap memory held by one or more containers, what they use against what they allocated.
+ */
+struct FMemoryFootprint
+{
+	// Bytes taken by the elements themselves
+	SIZE_T UsedBytes = 0;
+	// Bytes actually allocated, capacity included
+	SIZE_T AllocatedBytes = 0;
+
+	FORCEINLINE SIZE_T GetSlackBytes() const { return AllocatedBytes - UsedBytes; }
+
+	template<typename ElementType, typename AllocatorType>
+	FORCEINLINE void Add(const TArray<ElementType, AllocatorType>& Array)
+	{
+		UsedBytes += Array.Num() * sizeof(ElementType);
+		AllocatedBytes += Array.GetAllocatedSize();
+	}
+
+	FORCEINLINE FMemoryFootprint& operator+=(const FMemoryFootprint& Other)
+	{
+		UsedBytes += Other.UsedBytes;
+		AllocatedBytes += Other.AllocatedBytes;
+		return *this;
+	}
+
+	/**
+	 * @brief Per field maximum, for high water marks.
+	 */
+	static FORCEINLINE FMemoryFootprint Max(const FMemoryFootprint& A, const FMemoryFootprint& B)
+	{
+		FMemoryFootprint Result;
+		Result.UsedBytes = FMath::Max(A.UsedBytes, B.UsedBytes);
+		Result.AllocatedBytes = FMath::Max(A.AllocatedBytes, B.AllocatedBytes);
+		return Result;
+	}
+};
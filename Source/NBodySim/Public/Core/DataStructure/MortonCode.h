@@ -0,0 +1,74 @@
+#pragma once
+#include "QuadrantBounds.h"
+
+/**
+ * @brief Helpers for 2D Morton (Z-order) keys.
+ * Keys interleave 16 bits per axis with X on the even bits, so every pair of bits from the top down matches the
+ * EQuadrantLocation index of the quadrant the location falls in at that depth.
+ */
+struct FMortonCode
+{
+	static constexpr int BitsPerAxis = 16;
+	static constexpr uint32 MaxAxisValue = (1u << BitsPerAxis) - 1;
+
+	/**
+	 * @brief Spreads the lower 16 bits of Value so there is a zero bit between each of them.
+	 */
+	static FORCEINLINE uint32 SpreadBits(uint32 Value)
+	{
+		Value &= 0x0000FFFF;
+		Value = (Value | (Value << 8)) & 0x00FF00FF;
+		Value = (Value | (Value << 4)) & 0x0F0F0F0F;
+		Value = (Value | (Value << 2)) & 0x33333333;
+		Value = (Value | (Value << 1)) & 0x55555555;
+		return Value;
+	}
+
+	/**
+	 * @brief Inverse of SpreadBits, gathers the even bits of Value into its lower 16 bits.
+	 */
+	static FORCEINLINE uint32 CompactBits(uint32 Value)
+	{
+		Value &= 0x55555555;
+		Value = (Value | (Value >> 1)) & 0x33333333;
+		Value = (Value | (Value >> 2)) & 0x0F0F0F0F;
+		Value = (Value | (Value >> 4)) & 0x00FF00FF;
+		Value = (Value | (Value >> 8)) & 0x0000FFFF;
+		return Value;
+	}
+
+	static FORCEINLINE uint32 Encode(const uint32 X, const uint32 Y)
+	{
+		return SpreadBits(X) | (SpreadBits(Y) << 1);
+	}
+
+	static FORCEINLINE void Decode(const uint32 Key, uint32& OutX, uint32& OutY)
+	{
+		OutX = CompactBits(Key);
+		OutY = CompactBits(Key >> 1);
+	}
+
+	/**
+	 * @brief Quantizes a location to the 2^16 x 2^16 grid spanning Bounds and returns its key.
+	 * Locations outside the bounds are clamped to the edge cells.
+	 */
+	static FORCEINLINE uint32 FromLocation(const FVector2f Location, const FQuadrantBounds& Bounds)
+	{
+		constexpr float GridSize = 1 << BitsPerAxis;
+		const float X = (Location.X - Bounds.Left) / Bounds.HorizontalSize() * GridSize;
+		const float Y = (Location.Y - Bounds.Top) / Bounds.VerticalSize() * GridSize;
+
+		return Encode(
+			FMath::Clamp<int32>(FMath::FloorToInt32(X), 0, MaxAxisValue),
+			FMath::Clamp<int32>(FMath::FloorToInt32(Y), 0, MaxAxisValue)
+		);
+	}
+
+	/**
+	 * @brief Returns the quadrant index of the key at the given depth, 0 being the split directly below the root.
+	 */
+	static FORCEINLINE uint32 GetQuadrantDigit(const uint32 Key, const int Depth)
+	{
+		return (Key >> (2 * (BitsPerAxis - 1 - Depth))) & 3;
+	}
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "TreeNode.h"
+
+/**
+ * @brief Quadrupole moments of tree nodes, kept in an array parallel to the nodes so TTreeNode stays packed.
+ * The force law is the gradient of a 2D logarithmic potential, so with complex Z from a body to a node's center of
+ * mass, the node's field is the conjugate of Mass / Z + Q / Z^3 where Q sums m * W^2 over the complex offsets W of its
+ * bodies from the center of mass. The dipole term vanishes about the center of mass, so Q (X: real, Y: imaginary) is
+ * the whole second order correction.
+ */
+template<int BranchSize>
+struct TQuadrupoleMoments
+{
+	/**
+	 * @brief Computes the moment of every node bottom-up, from the children's moments shifted to their parent's
+	 * center of mass, or from a bucket's own bodies.
+	 * @param Tree The tree, must stay unchanged for as long as the moments are used
+	 * @param NumNodes Number of nodes in the tree
+	 * @param OutQuadrupoles Moment of every node, indexed like the nodes
+	 */
+	static void Compute(const TTreeView<BranchSize>& Tree, const int NumNodes, TArray<FVector2f>& OutQuadrupoles)
+	{
+		OutQuadrupoles.SetNumUninitialized(NumNodes);
+
+		// Children always come after their parent in every tree backend, so walking backwards sees every child first
+		for (int NodeIndex = NumNodes - 1; NodeIndex >= 0; NodeIndex--)
+		{
+			const TTreeNode<BranchSize>& Node = Tree.Nodes[NodeIndex];
+			FVector2f Quadrupole(0);
+
+			if (Node.IsCluster())
+			{
+				for (int QuadIndex = 0; QuadIndex < BranchSize; QuadIndex++)
+				{
+					const uint32 ChildIndex = Node.FirstChild + QuadIndex;
+					const TTreeNode<BranchSize>& Child = Tree.Nodes[ChildIndex];
+					if (Child.IsEmpty())
+						continue;
+
+					// Parallel axis, the child's own moment plus its mass at its offset from the parent
+					Quadrupole += OutQuadrupoles[ChildIndex] +
+						ComplexSquare(Child.CenterOfMass - Node.CenterOfMass) * Child.Mass;
+				}
+			}
+			else if (Node.IsBucket())
+			{
+				const uint32 BucketEnd = Node.FirstBody + Node.NumBodies;
+				for (uint32 LeafBody = Node.FirstBody; LeafBody < BucketEnd; LeafBody++)
+				{
+					Quadrupole += ComplexSquare(Tree.GetLeafBodyLocation(LeafBody) - Node.CenterOfMass) *
+						Tree.LeafMass[LeafBody];
+				}
+			}
+
+			// Singletons are a single body, or bodies folded together at the minimum node size, no spread either way
+			OutQuadrupoles[NodeIndex] = Quadrupole;
+		}
+	}
+
+	/**
+	 * @brief Velocity change the quadrupole term of a node applies to a body, on top of the monopole's
+	 * Dist * (Mass / Dist.SquaredLength()).
+	 * @param Dist From the body to the node's center of mass
+	 * @param Quadrupole The node's moment
+	 */
+	static FORCEINLINE FVector2f Evaluate(const FVector2f Dist, const FVector2f Quadrupole)
+	{
+		// conj(Q / Z^3) = conj(Q) * Z^3 / |Z|^6
+		const FVector2f DistCubed = ComplexMultiply(ComplexSquare(Dist), Dist);
+		const float InvSquaredLength = 1.f / Dist.SquaredLength();
+		return ComplexMultiply(FVector2f(Quadrupole.X, -Quadrupole.Y), DistCubed) *
+			(InvSquaredLength * InvSquaredLength * InvSquaredLength);
+	}
+
+private:
+	static FORCEINLINE FVector2f ComplexMultiply(const FVector2f A, const FVector2f B)
+	{
+		return FVector2f(A.X * B.X - A.Y * B.Y, A.X * B.Y + A.Y * B.X);
+	}
+
+	static FORCEINLINE FVector2f ComplexSquare(const FVector2f A)
+	{
+		return FVector2f(A.X * A.X - A.Y * A.Y, 2 * A.X * A.Y);
+	}
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include "MemoryFootprint.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * @brief Stable LSD radix sort of 32 bit keys, each carrying a 32 bit value along, split across workers.
+ * Scratch arrays & histograms are kept between sorts to avoid reallocating them every frame.
+ */
+class FRadixSort
+{
+	static constexpr int RadixBits = 8;
+	static constexpr int RadixBuckets = 1 << RadixBits;
+	static constexpr uint32 RadixMask = RadixBuckets - 1;
+
+	// Below this many keys per chunk the parallel radix passes cost more than they save
+	static constexpr int MinKeysPerChunk = 4096;
+
+	// Swapped with the sorted arrays every radix pass
+	TArray<uint32> ScratchKeys;
+	TArray<uint32> ScratchValues;
+	TArray<int> RadixHistograms;
+
+public:
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(ScratchKeys);
+		Footprint.Add(ScratchValues);
+		Footprint.Add(RadixHistograms);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Sorts the keys in ascending order, moving every value along with its key. Equal keys keep their order.
+	 * @param Keys Keys to sort
+	 * @param Values Value of every key, same number as Keys
+	 * @param NumWorkers Number of workers to split the radix passes across
+	 */
+	void Sort(TArray<uint32>& Keys, TArray<uint32>& Values, const int NumWorkers)
+	{
+		check(Keys.Num() == Values.Num());
+
+		const int Num = Keys.Num();
+		const int NumChunks = FMath::Clamp(Num / MinKeysPerChunk, 1, FMath::Max(NumWorkers, 1));
+		const int ChunkSize = FMath::DivideAndRoundUp(Num, NumChunks);
+
+		ScratchKeys.SetNumUninitialized(Num);
+		ScratchValues.SetNumUninitialized(Num);
+		RadixHistograms.SetNumUninitialized(NumChunks * RadixBuckets);
+
+		// Every chunk histograms & scatters its own keys so each pass stays stable
+		for (int Shift = 0; Shift < 32; Shift += RadixBits)
+		{
+			ParallelFor(NumChunks, [&](const int Chunk)
+			{
+				int* Histogram = &RadixHistograms[Chunk * RadixBuckets];
+				FMemory::Memzero(Histogram, RadixBuckets * sizeof(int));
+
+				const int ChunkEnd = FMath::Min(Num, (Chunk + 1) * ChunkSize);
+				for (int i = Chunk * ChunkSize; i < ChunkEnd; i++)
+					++Histogram[(Keys[i] >> Shift) & RadixMask];
+			});
+
+			// Turn the counts into per chunk write cursors, bucket major so chunks keep their relative order
+			int Offset = 0;
+			bool bIsSingleBucket = false;
+			for (int Bucket = 0; Bucket < RadixBuckets; Bucket++)
+			{
+				const int BucketStart = Offset;
+				for (int Chunk = 0; Chunk < NumChunks; Chunk++)
+				{
+					int& Count = RadixHistograms[Chunk * RadixBuckets + Bucket];
+					const int ChunkCount = Count;
+					Count = Offset;
+					Offset += ChunkCount;
+				}
+				bIsSingleBucket |= Offset - BucketStart == Num;
+			}
+
+			// Every key shares this digit, the pass wouldn't move anything
+			if (bIsSingleBucket)
+				continue;
+
+			ParallelFor(NumChunks, [&](const int Chunk)
+			{
+				int* Cursors = &RadixHistograms[Chunk * RadixBuckets];
+
+				const int ChunkEnd = FMath::Min(Num, (Chunk + 1) * ChunkSize);
+				for (int i = Chunk * ChunkSize; i < ChunkEnd; i++)
+				{
+					const int Destination = Cursors[(Keys[i] >> Shift) & RadixMask]++;
+					ScratchKeys[Destination] = Keys[i];
+					ScratchValues[Destination] = Values[i];
+				}
+			});
+
+			Swap(Keys, ScratchKeys);
+			Swap(Values, ScratchValues);
+		}
+	}
+};
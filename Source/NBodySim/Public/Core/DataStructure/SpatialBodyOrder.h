@@ -0,0 +1,214 @@
+#pragma once
+#include "BodyArray.h"
+#include "MortonCode.h"
+#include "RadixSort.h"
+#include "Async/ParallelFor.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/**
+ * @brief Keeps the body arrays in Morton order, so bodies next to each other in memory are next to each other in space.
+ * Consecutive bodies then walk mostly the same tree nodes & hit the same leaves, whichever worker they're handed to.
+ * Bodies keep a stable index, handed out in spawn order & never changed by a reorder, which is what the render data,
+ * the Niagara particles & the Blueprint body accessors address bodies by.
+ * Bodies drift out of order as they move, the order is only redone once they moved far enough on average to reach
+ * their neighbours' places, see ShouldReorder.
+ */
+class FSpatialBodyOrder
+{
+	// Stable index of every body, in storage order
+	TArray<uint32> StableIndices;
+	// Storage index of every stable index
+	TArray<uint32> StorageIndices;
+	// Whether StableIndices is still the identity, nothing was reordered since the last reset
+	bool bIsIdentity = true;
+
+	// Mean distance the bodies moved since the last reorder
+	double MeanDrift = 0;
+	// Bodies appended since the last reorder, sitting unsorted at the end of the arrays
+	int NumUnsortedBodies = 0;
+
+	// Reorder scratch, keys & the storage index each key belongs to, the gathered bodies & their stable indices
+	TArray<uint32> Keys;
+	TArray<uint32> Order;
+	FRadixSort RadixSort;
+	FBodyArray ScratchBodies;
+	TArray<uint32> ScratchStableIndices;
+
+	// Summed body speeds of every chunk of the drift pass
+	TArray<double> ChunkSpeeds;
+
+	// Bodies per chunk of the drift pass, small chunks would cost more to schedule than to sum
+	static constexpr int DriftChunkSize = 16384;
+
+public:
+	FORCEINLINE bool IsIdentity() const { return bIsIdentity; }
+
+	FORCEINLINE int Num() const { return StableIndices.Num(); }
+
+	/**
+	 * @brief Stable index of every body, in storage order.
+	 */
+	FORCEINLINE TArrayView<const uint32> GetStableIndices() const { return StableIndices; }
+
+	FORCEINLINE uint32 GetStableIndex(const int BodyIndex) const { return StableIndices[BodyIndex]; }
+
+	/**
+	 * @brief Where the body with the given stable index is currently stored, INDEX_NONE if there is no such body.
+	 */
+	FORCEINLINE int GetBodyIndex(const int StableIndex) const
+	{
+		return StorageIndices.IsValidIndex(StableIndex) ? StaticCast<int>(StorageIndices[StableIndex]) : INDEX_NONE;
+	}
+
+	FORCEINLINE double GetMeanDrift() const { return MeanDrift; }
+
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(StableIndices);
+		Footprint.Add(StorageIndices);
+		Footprint.Add(Keys);
+		Footprint.Add(Order);
+		Footprint += RadixSort.GetMemoryFootprint();
+		Footprint += ScratchBodies.GetMemoryFootprint();
+		Footprint.Add(ScratchStableIndices);
+		Footprint.Add(ChunkSpeeds);
+		return Footprint;
+	}
+
+	void Reset()
+	{
+		StableIndices.Reset();
+		StorageIndices.Reset();
+		bIsIdentity = true;
+		MeanDrift = 0;
+		NumUnsortedBodies = 0;
+	}
+
+	/**
+	 * @brief Hands out stable indices to bodies appended since the last call, in the order they were appended.
+	 * @param NumBodies Number of bodies now stored
+	 */
+	void AddBodies(const int NumBodies)
+	{
+		check(NumBodies >= StableIndices.Num());
+		for (int BodyIndex = StableIndices.Num(); BodyIndex < NumBodies; BodyIndex++)
+		{
+			StableIndices.Add(BodyIndex);
+			StorageIndices.Add(BodyIndex);
+			++NumUnsortedBodies;
+		}
+	}
+
+	/**
+	 * @brief Adds the mean distance the bodies move this step to the drift since the last reorder.
+	 */
+	void AccumulateDrift(const FBodyArray& Bodies, const float DeltaTime)
+	{
+		const int NumBodies = Bodies.Num();
+		if (NumBodies == 0)
+			return;
+
+		const int NumChunks = FMath::DivideAndRoundUp(NumBodies, DriftChunkSize);
+		ChunkSpeeds.SetNumUninitialized(NumChunks);
+		ParallelFor(NumChunks, [&](const int Chunk)
+		{
+			const float* RESTRICT VXData = Bodies.VX.GetData();
+			const float* RESTRICT VYData = Bodies.VY.GetData();
+			const int ChunkEnd = FMath::Min(NumBodies, (Chunk + 1) * DriftChunkSize);
+
+			double Speeds = 0;
+			for (int i = Chunk * DriftChunkSize; i < ChunkEnd; i++)
+				Speeds += FMath::Sqrt(VXData[i] * VXData[i] + VYData[i] * VYData[i]);
+			ChunkSpeeds[Chunk] = Speeds;
+		});
+
+		double TotalSpeed = 0;
+		for (const double Speed : ChunkSpeeds)
+			TotalSpeed += Speed;
+
+		MeanDrift += TotalSpeed / NumBodies * DeltaTime;
+	}
+
+	/**
+	 * @brief Whether the bodies drifted far enough from their place in the order to be worth sorting again.
+	 * @param Bounds Bounds the bodies are spread over
+	 * @param DriftSpacings Mean drift a reorder is triggered at, in mean distances between neighbouring bodies
+	 * @param MaxUnsortedFraction Fraction of unsorted spawned bodies a reorder is triggered at
+	 */
+	bool ShouldReorder(const FQuadrantBounds& Bounds, const float DriftSpacings, const float MaxUnsortedFraction) const
+	{
+		const int NumBodies = StableIndices.Num();
+		if (NumBodies < 2)
+			return false;
+
+		if (NumUnsortedBodies > MaxUnsortedFraction * NumBodies)
+			return true;
+
+		// Side of the square every body would get if they were spread evenly
+		const double MeanSpacing = FMath::Sqrt(StaticCast<double>(Bounds.HorizontalSize()) * Bounds.VerticalSize() /
+			NumBodies);
+		return MeanDrift > DriftSpacings * MeanSpacing;
+	}
+
+	/**
+	 * @brief Sorts every body stream into Morton order over the bounds, stable indices following their body.
+	 * @param Bodies Bodies to sort, stable indices must have been handed out to all of them
+	 * @param Bounds Bounds the Morton keys span, bodies outside are clamped to the edges
+	 * @param NumWorkers Number of workers to split the sort & gather across
+	 */
+	void Reorder(FBodyArray& Bodies, const FQuadrantBounds& Bounds, const int NumWorkers)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FSpatialBodyOrder::Reorder);
+
+		const int NumBodies = Bodies.Num();
+		check(NumBodies == StableIndices.Num());
+
+		Keys.SetNumUninitialized(NumBodies);
+		Order.SetNumUninitialized(NumBodies);
+		ParallelFor(NumBodies, [&](const int BodyIndex)
+		{
+			Keys[BodyIndex] = FMortonCode::FromLocation(Bodies.GetLocation(BodyIndex), Bounds);
+			Order[BodyIndex] = BodyIndex;
+		});
+		RadixSort.Sort(Keys, Order, NumWorkers);
+
+		// Gather every stream into the scratch arrays, then swap them in, so each stream is read & written once
+		ScratchBodies.X.SetNumUninitialized(NumBodies);
+		ScratchBodies.Y.SetNumUninitialized(NumBodies);
+		ScratchBodies.VX.SetNumUninitialized(NumBodies);
+		ScratchBodies.VY.SetNumUninitialized(NumBodies);
+		ScratchBodies.Mass.SetNumUninitialized(NumBodies);
+		ScratchBodies.Cost.SetNumUninitialized(NumBodies);
+		ScratchBodies.TimeStepLevel.SetNumUninitialized(NumBodies);
+		ScratchStableIndices.SetNumUninitialized(NumBodies);
+		ParallelFor(NumBodies, [&](const int BodyIndex)
+		{
+			const uint32 SourceIndex = Order[BodyIndex];
+			ScratchBodies.X[BodyIndex] = Bodies.X[SourceIndex];
+			ScratchBodies.Y[BodyIndex] = Bodies.Y[SourceIndex];
+			ScratchBodies.VX[BodyIndex] = Bodies.VX[SourceIndex];
+			ScratchBodies.VY[BodyIndex] = Bodies.VY[SourceIndex];
+			ScratchBodies.Mass[BodyIndex] = Bodies.Mass[SourceIndex];
+			ScratchBodies.Cost[BodyIndex] = Bodies.Cost[SourceIndex];
+			ScratchBodies.TimeStepLevel[BodyIndex] = Bodies.TimeStepLevel[SourceIndex];
+
+			const uint32 StableIndex = StableIndices[SourceIndex];
+			ScratchStableIndices[BodyIndex] = StableIndex;
+			StorageIndices[StableIndex] = BodyIndex;
+		});
+
+		Swap(Bodies.X, ScratchBodies.X);
+		Swap(Bodies.Y, ScratchBodies.Y);
+		Swap(Bodies.VX, ScratchBodies.VX);
+		Swap(Bodies.VY, ScratchBodies.VY);
+		Swap(Bodies.Mass, ScratchBodies.Mass);
+		Swap(Bodies.Cost, ScratchBodies.Cost);
+		Swap(Bodies.TimeStepLevel, ScratchBodies.TimeStepLevel);
+		Swap(StableIndices, ScratchStableIndices);
+
+		bIsIdentity = false;
+		MeanDrift = 0;
+		NumUnsortedBodies = 0;
+	}
+};
@@ -2,18 +2,18 @@
 
 #include "BodyDescriptor.h"
 #include "QuadrantBounds.h"
-
-#include "Core/Threading/FAtomicMutex.h"
-#include "Core/Threading/FAtomicScopeLock.h"
-
-class FBarnesHutTree;
-class FQuadTreeNodeIter;
+#include "Containers/StaticArray.h"
+#include <atomic>
 
 enum class ENodeType : uint8
 {
 	Empty,
 	Cluster,
-	Singleton
+	Singleton,
+	// Leaf holding up to the tree's leaf capacity bodies, stored contiguously in the tree's leaf streams
+	Bucket,
+	// Claimed by a worker of a concurrent build while it's being written, never left in a built tree
+	Locked
 };
 
 enum ETreeBranchSize
@@ -23,128 +23,168 @@ enum ETreeBranchSize
 };
 
 /**
- * @brief Barnes Hut algorithm implementation specific QuadTree. This is an extension of FQuadTreeNode that includes
- *  more logic and per-node contiguous allocation behavior.
+ * @brief Packed Barnes Hut tree node.
+ * Nodes live in one flat array owned by their tree, a cluster's children are the BranchSize contiguous nodes starting
+ * at FirstChild. Only the monopole (mass & center of mass) is stored, bounds are derived from the depth (size) or
+ * rebuilt while walking down from the root (position), see TTreeView.
  */
 template<int BranchSize>
-class alignas(32) TTreeNode
+struct TTreeNode
 {
-	template<int>
-	friend class TBarnesHutTree;
+	FVector2f CenterOfMass = FVector2f(0);
+	float Mass = 0;
 
-public:
-	class FIterator
+	union
 	{
-		friend class TTreeNode;
+		// Index of the first child in the owning tree's node array, only valid for clusters
+		uint32 FirstChild = 0;
 
-	private:
-		explicit FIterator(const TTreeNode* ParentNode, const int Index = 0):
-			Index(Index),
-			ParentNode(ParentNode)
-		{
-			check(ParentNode != nullptr);
-			check(ParentNode->IsCluster());
-		}
+		// Index of the body held by a singleton, InvalidBodyIndex if it holds several bodies folded together
+		uint32 BodyIndex;
 
-	public:
-		FIterator() = delete;
-
-		FORCEINLINE TTreeNode& operator*() const { return ParentNode->GetLeaf(Index); }
-		FORCEINLINE TTreeNode* operator->() const { return &ParentNode->GetLeaf(Index); }
-
-		FORCEINLINE FIterator& operator++()
-		{
-			++Index;
-			return *this;
-		}
-
-		FORCEINLINE FIterator operator++(int)
-		{
-			const FIterator Tmp = *this;
-			++(*this);
-			return Tmp;
-		}
+		// Index of the first body of a bucket in the owning tree's leaf streams
+		uint32 FirstBody;
+	};
 
-		FORCEINLINE FIterator& operator--()
-		{
-			--Index;
-			return *this;
-		}
+	uint8 Depth = 0;
+	ENodeType NodeType = ENodeType::Empty;
 
-		FORCEINLINE FIterator operator--(int)
-		{
-			const FIterator Tmp = *this;
-			--(*this);
-			return Tmp;
-		}
+	// Number of bodies held by a bucket
+	uint16 NumBodies = 0;
 
-		FORCEINLINE bool operator==(const FIterator& Other) const
-		{
-			return ParentNode == Other.ParentNode && Index == Other.Index;
-		};
-		FORCEINLINE bool operator!=(const FIterator& Other) const { return !(*this == Other); };
+	static constexpr uint32 InvalidBodyIndex = MAX_uint32;
 
-	private:
-		int Index;
-		const TTreeNode* ParentNode;
-	};
+	TTreeNode() = default;
 
-	FBodyDescriptor BodyDescriptor;
-	FQuadrantBounds NodeBounds;
-	ENodeType NodeType;
+	explicit TTreeNode(const uint8 Depth) : Depth(Depth)
+	{
+	}
 
-private:
-	TArray<TTreeNode*, TFixedAllocator<BranchSize>> Leaves;
-	FAtomicMutex Mutex;
+	FORCEINLINE bool IsCluster() const { return NodeType == ENodeType::Cluster; }
+	FORCEINLINE bool IsSingleton() const { return NodeType == ENodeType::Singleton; }
+	FORCEINLINE bool IsEmpty() const { return NodeType == ENodeType::Empty; }
+	FORCEINLINE bool IsBucket() const { return NodeType == ENodeType::Bucket; }
 
-	explicit TTreeNode(const FQuadrantBounds NodeBounds) :
-		NodeBounds(NodeBounds),
-		NodeType(ENodeType::Empty)
+	/**
+	 * @brief The node type as an atomic, concurrent builds claim a node by compare and swapping its type to Locked.
+	 */
+	FORCEINLINE std::atomic<ENodeType>& GetAtomicNodeType()
 	{
-		Leaves.Init(nullptr, BranchSize);
+		return *reinterpret_cast<std::atomic<ENodeType>*>(&NodeType);
 	}
 
-public:
-	TTreeNode(TTreeNode&& Other) noexcept
+	FORCEINLINE uint32 GetChildIndex(const int Location) const
 	{
-		FAtomicScopeLock(Other.Mutex);
-		BodyDescriptor = Other.BodyDescriptor;
-		NodeBounds = Other.NodeBounds;
-		NodeType = Other.NodeType;
-		Leaves.Init(nullptr, BranchSize);
+		check(IsCluster());
+		check(Location < BranchSize && Location >= 0);
+		return FirstChild + Location;
 	}
 
-private:
-	FORCEINLINE TTreeNode& GetLeaf(const EQuadrantLocation Location) const
+	FORCEINLINE uint32 GetChildIndex(const EQuadrantLocation Location) const
 	{
-		return *Leaves[StaticCast<int>(Location)];
+		return GetChildIndex(StaticCast<int>(Location));
 	}
 
-	FORCEINLINE TTreeNode& GetLeaf(const int Location) const
+	/**
+	 * @brief The node's mass as a pseudo body, for code that works on FBodyDescriptor.
+	 */
+	FORCEINLINE FBodyDescriptor AsBody() const { return FBodyDescriptor(CenterOfMass, Mass); }
+
+	/**
+	 * @brief Places a single body in this node as is.
+	 */
+	FORCEINLINE void SetBody(const FBodyDescriptor& Body, const uint32 InBodyIndex)
 	{
-		check(Location < Leaves.Num() && Location >= 0);
-		check(Leaves[Location]);
-		return *Leaves[Location];
+		CenterOfMass = Body.Location;
+		Mass = Body.Mass;
+		BodyIndex = InBodyIndex;
 	}
 
-	void InsertLeaf(int Location, TTreeNode* Node)
+	/**
+	 * @brief Adds a body's mass to this node, moving the center of mass accordingly.
+	 */
+	FORCEINLINE void AccumulateMass(const FVector2f Location, const float BodyMass)
 	{
-		check(Leaves.Num() == BranchSize);
-		Leaves[Location] = Node;
+		// CoM = (M1 * P1 + M2 * P2) / TotalMass
+		const auto M1P1 = Mass * CenterOfMass;
+		const auto M2P2 = BodyMass * Location;
+		const auto TotalMass = BodyMass + Mass;
+
+		CenterOfMass = (M1P1 + M2P2) / TotalMass;
+
+		// Update total mass
+		Mass = TotalMass;
 	}
 
-	void InsertLeaf(EQuadrantLocation Location, TTreeNode* Node)
+	FORCEINLINE void AccumulateMass(const FBodyDescriptor& Body) { AccumulateMass(Body.Location, Body.Mass); }
+
+	FORCEINLINE void AccumulateMass(const TTreeNode& Node) { AccumulateMass(Node.CenterOfMass, Node.Mass); }
+};
+
+static_assert(sizeof(TTreeNode<ETreeBranchSize::QuadTree>) <= 24, "Tree nodes are expected to stay packed.");
+static_assert(sizeof(std::atomic<ENodeType>) == sizeof(ENodeType) && std::atomic<ENodeType>::is_always_lock_free,
+              "Node types are expected to be usable as lock free atomics in place.");
+
+/**
+ * @brief Read only view over a tree's flat node array, shared by every tree backend so the force pass & debug
+ * drawing don't need to know which tree built the nodes.
+ */
+template<int BranchSize>
+struct TTreeView
+{
+	// Deepest level a node length is tracked for, far below anything MinNodeSize lets the trees reach
+	static constexpr int MaxDepth = 32;
+
+	const TTreeNode<BranchSize>* Nodes = nullptr;
+	FQuadrantBounds RootBounds;
+
+	// Diagonal length of a node at every depth
+	TStaticArray<float, MaxDepth> NodeLengths;
+
+	// Bodies held by bucket leaves, in leaf order. Only set by trees that build bucket leaves.
+	const float* LeafX = nullptr;
+	const float* LeafY = nullptr;
+	const float* LeafMass = nullptr;
+	const uint32* LeafBodyIndices = nullptr;
+
+	// Quadrupole moment of every node, see TQuadrupoleMoments. Only set when moments were computed for the tree.
+	const FVector2f* Quadrupoles = nullptr;
+
+	TTreeView() = default;
+
+	TTreeView(const TTreeNode<BranchSize>* Nodes, const FQuadrantBounds RootBounds) :
+		Nodes(Nodes),
+		RootBounds(RootBounds)
 	{
-		InsertLeaf(StaticCast<int>(Location), Node);
+		float Length = RootBounds.Length();
+		for (int Depth = 0; Depth < MaxDepth; Depth++)
+		{
+			NodeLengths[Depth] = Length;
+			Length *= 0.5f;
+		}
 	}
 
-public:
-	FORCEINLINE bool IsCluster() const { return NodeType == ENodeType::Cluster; }
-	FORCEINLINE bool IsSingleton() const { return NodeType == ENodeType::Singleton; }
-	FORCEINLINE bool IsEmpty() const { return NodeType == ENodeType::Empty; }
+	FORCEINLINE const TTreeNode<BranchSize>& GetRootNode() const { return Nodes[0]; }
 
+	FORCEINLINE const TTreeNode<BranchSize>& GetNode(const uint32 Index) const { return Nodes[Index]; }
 
-	FORCEINLINE FIterator begin() const { return FIterator(this); }
+	FORCEINLINE float GetNodeLength(const TTreeNode<BranchSize>& Node) const
+	{
+		check(Node.Depth < MaxDepth);
+		return NodeLengths[Node.Depth];
+	}
+
+	/**
+	 * @brief Children of a cluster node, usable in range based for loops.
+	 */
+	FORCEINLINE TArrayView<const TTreeNode<BranchSize>> GetChildren(const TTreeNode<BranchSize>& Node) const
+	{
+		check(Node.IsCluster());
+		return TArrayView<const TTreeNode<BranchSize>>(Nodes + Node.FirstChild, BranchSize);
+	}
 
-	FORCEINLINE FIterator end() const { return FIterator(this, BranchSize); }
+	FORCEINLINE FVector2f GetLeafBodyLocation(const uint32 LeafBody) const
+	{
+		return FVector2f(LeafX[LeafBody], LeafY[LeafBody]);
+	}
 };
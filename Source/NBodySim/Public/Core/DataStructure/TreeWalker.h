@@ -0,0 +1,257 @@
+#pragma once
+#include "TreeNode.h"
+
+/**
+ * @brief What a single tree walk did, for stats & load balancing.
+ */
+struct FTreeWalkStats
+{
+	// Bodies & pseudo bodies handed to the visitor
+	int NumAccepted = 0;
+
+	// Clusters & buckets too close to be accepted, whose children or bodies were visited instead
+	int NumOpened = 0;
+
+	FORCEINLINE FTreeWalkStats& operator+=(const FTreeWalkStats& Other)
+	{
+		NumAccepted += Other.NumAccepted;
+		NumOpened += Other.NumOpened;
+		return *this;
+	}
+};
+
+/**
+ * @brief Non recursive Barnes Hut tree walk.
+ * Uses an explicit fixed size stack of node indices, prefetches a cluster's children as soon as it's opened, and skips
+ * self interaction by comparing body indices instead of comparing bodies. Everything is inlined into the caller,
+ * including the visitor.
+ * Visitors are called with the location & mass of every accepted (pseudo) body, node visitors with every accepted
+ * cluster or bucket node & its index, for callers that need more than the node's monopole.
+ */
+template<int BranchSize>
+struct TTreeWalker
+{
+	// Every level can leave at most BranchSize - 1 siblings behind on the stack
+	static constexpr int StackSize = TTreeView<BranchSize>::MaxDepth * (BranchSize - 1) + 1;
+
+	// Relative slack on a node's diagonal when checking whether it may contain a bucket, see WalkBucket
+	static constexpr float ContainmentSlack = 1.001f;
+
+	/**
+	 * @brief Visits every node accepted for a body, in the same order as a depth first recursive walk would.
+	 * @param Tree The tree to walk
+	 * @param Location Location of the body
+	 * @param BodyIndex Index of the body, leaves holding it skip it
+	 * @param AccuracyCoefficient Opening angle, nodes are accepted when NodeLength / Distance is below it
+	 * @param Visitor Called with every accepted body or pseudo body
+	 * @return The number of accepted (pseudo) bodies & opened nodes
+	 */
+	template<typename VisitorType>
+	static FORCEINLINE FTreeWalkStats Walk(const TTreeView<BranchSize>& Tree, const FVector2f Location,
+	                                       const uint32 BodyIndex, const float AccuracyCoefficient, VisitorType&& Visitor)
+	{
+		return Walk(Tree, Location, BodyIndex, AccuracyCoefficient, Visitor, MakeNodeVisitor(Visitor));
+	}
+
+	/**
+	 * @brief Same as Walk, but accepted clusters & buckets go to NodeVisitor instead of Visitor.
+	 * @param Visitor Called with every body that's visited as is
+	 * @param NodeVisitor Called with every accepted cluster or bucket & its node index
+	 */
+	template<typename VisitorType, typename NodeVisitorType>
+	static FORCEINLINE FTreeWalkStats Walk(const TTreeView<BranchSize>& Tree, const FVector2f Location,
+	                                       const uint32 BodyIndex, const float AccuracyCoefficient, VisitorType&& Visitor,
+	                                       NodeVisitorType&& NodeVisitor)
+	{
+		const float SquaredCoefficient = AccuracyCoefficient * AccuracyCoefficient;
+
+		return WalkInternal(Tree, Visitor, NodeVisitor,
+			[&](const TTreeNode<BranchSize>& Node, const float SquaredNodeLength)
+			{
+				// NodeLength / Distance < Coefficient, squared to avoid the square root
+				return SquaredNodeLength < SquaredCoefficient * (Node.CenterOfMass - Location).SquaredLength();
+			},
+			[BodyIndex](const uint32 NodeIndex, const uint32 LeafBodyIndex)
+			{
+				return LeafBodyIndex == BodyIndex;
+			},
+			NeverCulled());
+	}
+
+	/**
+	 * @brief Same as Walk, but nodes that can't hold anything within Radius of the body are skipped entirely, for
+	 * short range forces. Bodies & pseudo bodies handed to the visitor may still be a little further than Radius.
+	 * @param Radius Distance beyond which the caller's force vanishes
+	 */
+	template<typename VisitorType>
+	static FORCEINLINE FTreeWalkStats WalkWithinRadius(const TTreeView<BranchSize>& Tree, const FVector2f Location,
+	                                                   const uint32 BodyIndex, const float AccuracyCoefficient,
+	                                                   const float Radius, VisitorType&& Visitor)
+	{
+		const float SquaredCoefficient = AccuracyCoefficient * AccuracyCoefficient;
+
+		return WalkInternal(Tree, Visitor, MakeNodeVisitor(Visitor),
+			[&](const TTreeNode<BranchSize>& Node, const float SquaredNodeLength)
+			{
+				return SquaredNodeLength < SquaredCoefficient * (Node.CenterOfMass - Location).SquaredLength();
+			},
+			[BodyIndex](const uint32 NodeIndex, const uint32 LeafBodyIndex)
+			{
+				return LeafBodyIndex == BodyIndex;
+			},
+			[&](const TTreeNode<BranchSize>& Node, const float NodeLength)
+			{
+				// The center of mass is within the node, so none of its bodies are further than a diagonal from it
+				const float Reach = Radius + UE_SQRT_2 * NodeLength;
+				return (Node.CenterOfMass - Location).SquaredLength() > Reach * Reach;
+			});
+	}
+
+	/**
+	 * @brief Visits every node accepted for a whole bucket, so the result can be shared by all bodies in the bucket.
+	 * Nodes are accepted against the closest point of the bucket's bounding box rather than a single body.
+	 * The bucket itself is skipped, its bodies' interactions with each other are left to the caller, so nodes
+	 * containing it are never accepted, whatever the coefficient.
+	 * @param Tree The tree to walk
+	 * @param BucketNodeIndex Index of the bucket node
+	 * @param BucketMin Minimum corner of the box bounding the bucket's bodies
+	 * @param BucketMax Maximum corner of the box bounding the bucket's bodies
+	 * @param AccuracyCoefficient Opening angle, nodes are accepted when NodeLength / Distance is below it
+	 * @param Visitor Called with every accepted body or pseudo body
+	 * @return The number of accepted (pseudo) bodies & opened nodes
+	 */
+	template<typename VisitorType>
+	static FORCEINLINE FTreeWalkStats WalkBucket(const TTreeView<BranchSize>& Tree, const uint32 BucketNodeIndex,
+	                                             const FVector2f BucketMin, const FVector2f BucketMax,
+	                                             const float AccuracyCoefficient, VisitorType&& Visitor)
+	{
+		const float SquaredCoefficient = AccuracyCoefficient * AccuracyCoefficient;
+
+		return WalkInternal(Tree, Visitor, MakeNodeVisitor(Visitor),
+			[&](const TTreeNode<BranchSize>& Node, const float SquaredNodeLength)
+			{
+				// A node containing the bucket holds the bucket's own bodies, which the caller adds body by body, so
+				// it's always opened. Both its center of mass & the whole box lie within its cell, so they're no
+				// further apart than the cell's diagonal along either axis, nodes further than that can't contain the
+				// bucket. A little slack covers cells rounded differently by the tree that built them.
+				const float FarX = FMath::Max(FMath::Abs(Node.CenterOfMass.X - BucketMin.X),
+				                              FMath::Abs(Node.CenterOfMass.X - BucketMax.X));
+				const float FarY = FMath::Max(FMath::Abs(Node.CenterOfMass.Y - BucketMin.Y),
+				                              FMath::Abs(Node.CenterOfMass.Y - BucketMax.Y));
+				const float SquaredReach = SquaredNodeLength * ContainmentSlack;
+				if (FarX * FarX <= SquaredReach && FarY * FarY <= SquaredReach)
+					return false;
+
+				const FVector2f Outside = FVector2f(
+					FMath::Max3(BucketMin.X - Node.CenterOfMass.X, Node.CenterOfMass.X - BucketMax.X, 0.f),
+					FMath::Max3(BucketMin.Y - Node.CenterOfMass.Y, Node.CenterOfMass.Y - BucketMax.Y, 0.f));
+
+				return SquaredNodeLength < SquaredCoefficient * Outside.SquaredLength();
+			},
+			[BucketNodeIndex](const uint32 NodeIndex, const uint32 LeafBodyIndex)
+			{
+				return NodeIndex == BucketNodeIndex;
+			},
+			NeverCulled());
+	}
+
+private:
+	/**
+	 * @brief Node visitor handing accepted nodes to a plain visitor as pseudo bodies.
+	 */
+	template<typename VisitorType>
+	static FORCEINLINE auto MakeNodeVisitor(VisitorType& Visitor)
+	{
+		return [&Visitor](const TTreeNode<BranchSize>& Node, const uint32 NodeIndex)
+		{
+			Visitor(Node.CenterOfMass, Node.Mass);
+		};
+	}
+
+	static FORCEINLINE auto NeverCulled()
+	{
+		return [](const TTreeNode<BranchSize>& Node, const float NodeLength) { return false; };
+	}
+
+	/**
+	 * @param Tree The tree to walk
+	 * @param Visitor Called with every body visited as is
+	 * @param NodeVisitor Called with every accepted cluster or bucket
+	 * @param IsAccepted Returns whether a node is far enough to be used as a pseudo body
+	 * @param IsSkipped Returns whether a body held by the given leaf node should be skipped
+	 * @param IsCulled Returns whether a node & everything below it contributes nothing, checked before IsAccepted
+	 */
+	template<typename VisitorType, typename NodeVisitorType, typename AcceptType, typename SkipType,
+	         typename CullType>
+	static FORCEINLINE FTreeWalkStats WalkInternal(const TTreeView<BranchSize>& Tree, VisitorType& Visitor,
+	                                               NodeVisitorType&& NodeVisitor, AcceptType&& IsAccepted,
+	                                               SkipType&& IsSkipped, CullType&& IsCulled)
+	{
+		const TTreeNode<BranchSize>* RESTRICT Nodes = Tree.Nodes;
+
+		uint32 Stack[StackSize];
+		int StackTop = 0;
+		Stack[StackTop++] = 0;
+
+		FTreeWalkStats Stats;
+		while (StackTop > 0)
+		{
+			const uint32 NodeIndex = Stack[--StackTop];
+			const TTreeNode<BranchSize>& Node = Nodes[NodeIndex];
+
+			if (Node.IsEmpty())
+				continue;
+
+			const float NodeLength = Tree.NodeLengths[Node.Depth];
+			if (IsCulled(Node, NodeLength))
+				continue;
+
+			if (Node.IsSingleton())
+			{
+				if (!IsSkipped(NodeIndex, Node.BodyIndex))
+				{
+					Visitor(Node.CenterOfMass, Node.Mass);
+					++Stats.NumAccepted;
+				}
+				continue;
+			}
+
+			// A bucket holding a single body is that body, no point testing it
+			if (!Node.IsBucket() || Node.NumBodies > 1)
+			{
+				if (IsAccepted(Node, NodeLength * NodeLength))
+				{
+					NodeVisitor(Node, NodeIndex);
+					++Stats.NumAccepted;
+					continue;
+				}
+			}
+
+			++Stats.NumOpened;
+			if (Node.IsBucket())
+			{
+				const uint32 BucketEnd = Node.FirstBody + Node.NumBodies;
+				for (uint32 LeafBody = Node.FirstBody; LeafBody < BucketEnd; LeafBody++)
+				{
+					if (IsSkipped(NodeIndex, Tree.LeafBodyIndices[LeafBody]))
+						continue;
+
+					Visitor(Tree.GetLeafBodyLocation(LeafBody), Tree.LeafMass[LeafBody]);
+					++Stats.NumAccepted;
+				}
+				continue;
+			}
+
+			// Children are contiguous & usually span two cache lines, start pulling both in now
+			const TTreeNode<BranchSize>* Children = Nodes + Node.FirstChild;
+			FPlatformMisc::Prefetch(Children);
+			FPlatformMisc::Prefetch(Children, PLATFORM_CACHE_LINE_SIZE);
+
+			check(StackTop + BranchSize <= StackSize);
+			for (int QuadIndex = BranchSize - 1; QuadIndex >= 0; QuadIndex--)
+				Stack[StackTop++] = Node.FirstChild + QuadIndex;
+		}
+
+		return Stats;
+	}
+};
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "NiagaraActor.h"
+#include "Game/NBodySimulationSubsystem.h"
 
 #include "GameFramework/GameModeBase.h"
 #include "NBodySimGameModeBase.generated.h"
@@ -36,6 +37,10 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "NBody|Defaults")
 	bool bShouldAutoLoad;
 
+	// Force solver, NBodySim.Force.Solver overrides it at runtime
+	UPROPERTY(EditDefaultsOnly, Category = "NBody|Defaults")
+	ENBodySolver Solver = ENBodySolver::Auto;
+
 public:
 	virtual void BeginPlay() override;
 	
@@ -0,0 +1,157 @@
+#pragma once
+#include "Core/DataStructure/BodyArray.h"
+#include "Async/ParallelFor.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/**
+ * @brief Individual power of two block time steps, so bodies in quiet regions aren't recomputed every tick.
+ * Every body steps 2^Level ticks at once, the level being picked from its acceleration, and only starts a step on a
+ * tick its step length divides, so the bodies active on any tick are exactly the ones whose step just ended.
+ * Steps are kick-drift-kick: an active body's new force closes its last step with half that step's kick & opens the
+ * next one with half of its own, while every body drifts every tick. With every body at level 0 this is exactly the
+ * plain kick then drift the simulation otherwise runs.
+ * The force pass runs against zeroed velocities in between BeginForcePass & EndForcePass, so whatever it adds is the
+ * body's kick over one tick, whichever solver ran.
+ */
+class FBlockTimeStepper
+{
+public:
+	// 2^8 ticks, a body's acceleration could change completely in far less
+	static constexpr int MaxLevelLimit = 8;
+
+private:
+	int MaxLevel = 4;
+	float Accuracy = 0.2f;
+
+	// Ticks stepped so far, wrapping around is harmless as every step length divides 2^32
+	uint32 Tick = 0;
+
+	// Bodies starting a step this tick
+	TArray<uint32> ActiveBodies;
+
+	// Velocities the bodies had before the force pass
+	FBodyArray::FStream SavedVX;
+	FBodyArray::FStream SavedVY;
+
+public:
+	/**
+	 * @brief Sets the deepest level, bodies step at most 2^MaxLevel ticks at once.
+	 */
+	FORCEINLINE void SetMaxLevel(const int InMaxLevel) { MaxLevel = FMath::Clamp(InMaxLevel, 0, MaxLevelLimit); }
+
+	/**
+	 * @brief Sets the step length factor, a body's acceleration moves it Accuracy^2 / 2 length scales over a step.
+	 */
+	FORCEINLINE void SetAccuracy(const float InAccuracy) { Accuracy = FMath::Max(InAccuracy, 0.f); }
+
+	FORCEINLINE bool IsActive(const FBodyArray& Bodies, const int BodyIndex) const
+	{
+		return (Tick & ((1u << Bodies.TimeStepLevel[BodyIndex]) - 1)) == 0;
+	}
+
+	/**
+	 * @brief Bodies gathered by the last GatherActiveBodies.
+	 */
+	FORCEINLINE TArrayView<const uint32> GetActiveBodies() const { return ActiveBodies; }
+
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(ActiveBodies);
+		Footprint.Add(SavedVX);
+		Footprint.Add(SavedVY);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Starts over in sync, every body back at level 0.
+	 */
+	void Reset(FBodyArray& Bodies)
+	{
+		Tick = 0;
+		FMemory::Memzero(Bodies.TimeStepLevel.GetData(), Bodies.TimeStepLevel.Num());
+	}
+
+	/**
+	 * @brief Gathers the bodies starting a step this tick.
+	 * @param Bodies Bodies to gather from
+	 * @param Order Order to gather them in, storage order if empty
+	 */
+	void GatherActiveBodies(const FBodyArray& Bodies, const TArrayView<const uint32> Order)
+	{
+		const int NumBodies = Bodies.Num();
+		const bool bHasOrder = Order.Num() == NumBodies;
+
+		ActiveBodies.Reset();
+		for (int OrderIndex = 0; OrderIndex < NumBodies; OrderIndex++)
+		{
+			const uint32 BodyIndex = bHasOrder ? Order[OrderIndex] : OrderIndex;
+			if (IsActive(Bodies, BodyIndex))
+				ActiveBodies.Add(BodyIndex);
+		}
+	}
+
+	/**
+	 * @brief Puts the velocities aside & zeroes them, so the force pass only leaves its kicks behind.
+	 */
+	void BeginForcePass(FBodyArray& Bodies)
+	{
+		const int NumBodies = Bodies.Num();
+		Swap(Bodies.VX, SavedVX);
+		Swap(Bodies.VY, SavedVY);
+		Bodies.VX.SetNumUninitialized(NumBodies);
+		Bodies.VY.SetNumUninitialized(NumBodies);
+		FMemory::Memzero(Bodies.VX.GetData(), NumBodies * sizeof(float));
+		FMemory::Memzero(Bodies.VY.GetData(), NumBodies * sizeof(float));
+	}
+
+	/**
+	 * @brief Kicks the active bodies with what the force pass left, picks their next level, & puts every other body's
+	 * velocity back as it was. Advances to the next tick.
+	 * @param Bodies Bodies the force pass ran on
+	 * @param DeltaTime Time the bodies drift this tick
+	 * @param LengthScale Distance the acceleration criterion is measured against
+	 */
+	void EndForcePass(FBodyArray& Bodies, const float DeltaTime, const float LengthScale)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FBlockTimeStepper::EndForcePass);
+
+		// Kicks are per tick, a kick K moves a body K * DeltaTime further every tick, so after N ticks its
+		// acceleration moved it about K * DeltaTime * N^2 / 2. N is picked so that stays Accuracy^2 / 2 length scales.
+		const float LengthOverDeltaTime = DeltaTime > 0 ? LengthScale / DeltaTime : 0;
+
+		ParallelFor(Bodies.Num(), [&](const int i)
+		{
+			if (!IsActive(Bodies, i))
+			{
+				Bodies.VX[i] = SavedVX[i];
+				Bodies.VY[i] = SavedVY[i];
+				return;
+			}
+
+			const FVector2f Kick(Bodies.VX[i], Bodies.VY[i]);
+			const float KickLength = Kick.Length();
+
+			int Level = MaxLevel;
+			if (KickLength > 0)
+			{
+				const float NumTicks = FMath::Min(Accuracy * FMath::Sqrt(LengthOverDeltaTime / KickLength), 1e6f);
+				if (NumTicks < 1)
+					Level = 0;
+				else
+					Level = FMath::Min<int>(FMath::FloorLog2(FMath::FloorToInt32(NumTicks)), MaxLevel);
+			}
+
+			// Steps only start on ticks their length divides
+			while (Level > 0 && (Tick & ((1u << Level) - 1)) != 0)
+				--Level;
+
+			const float KickTicks = 0.5f * ((1 << Bodies.TimeStepLevel[i]) + (1 << Level));
+			Bodies.VX[i] = SavedVX[i] + Kick.X * KickTicks;
+			Bodies.VY[i] = SavedVY[i] + Kick.Y * KickTicks;
+			Bodies.TimeStepLevel[i] = Level;
+		});
+
+		++Tick;
+	}
+};
@@ -0,0 +1,213 @@
+#pragma once
+#include "PhiloxRandom.h"
+#include "Async/ParallelFor.h"
+#include "Core/DataStructure/BodyArray.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+enum class EBodyDistribution : uint8
+{
+	// Evenly spread over the whole bounds
+	Uniform,
+	// Gaussian blobs around a few random centers
+	Clustered,
+	// Projected Plummer sphere, dense core with long tails, the usual stand-in for a galaxy or star cluster
+	Plummer,
+	// Face on exponential disk, surface density falling off as exp(-R / ScaleLength) like a spiral galaxy's
+	ExponentialDisk,
+	// A few Plummer spheres of different sizes around the center, about to fall into each other
+	Merger
+};
+
+/**
+ * @brief Generates body sets following a given spatial distribution.
+ * Only positions & masses follow the distribution, every body starts at rest.
+ * Every body draws from its own counter based random stream, keyed by the seed & the body's spawn index, so bodies are
+ * generated in parallel & a seed always gives bit identical bodies, whatever the number of threads or the batches
+ * they were spawned in.
+ */
+struct FBodyDistribution
+{
+	// Number of blobs a clustered distribution is made of
+	static constexpr int NumClusters = 8;
+	// Number of spheres a merger is made of
+	static constexpr int NumMergerClusters = 3;
+
+	// Clusters' standard deviation, Plummer scale radius & disk scale length, relative to the bounds' smallest side
+	static constexpr float ClusterScale = 0.02f;
+	static constexpr float PlummerScale = 0.05f;
+	static constexpr float DiskScale = 0.08f;
+	// Distance of the merging spheres from the center, relative to the bounds' smallest side
+	static constexpr float MergerSeparation = 0.2f;
+
+	// Bodies per generation task, small chunks would cost more to schedule than to generate
+	static constexpr int GenerateChunkSize = 4096;
+
+	/**
+	 * @brief Appends NumBodies bodies following Distribution to OutBodies, always within Bounds.
+	 * A body's spawn index is its index in OutBodies, so a seed always spawns the same body at the same index.
+	 * @param Seed Seed of the run, every body & the distribution's layout derive from it
+	 */
+	static void Generate(const EBodyDistribution Distribution, const int NumBodies, const FQuadrantBounds& Bounds,
+	                     const float MinMass, const float MaxMass, const uint64 Seed, FBodyArray& OutBodies)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FBodyDistribution::Generate);
+
+		const FVector2f Center = Bounds.Midpoint();
+		const float Scale = FMath::Min(Bounds.HorizontalSize(), Bounds.VerticalSize());
+
+		// Layout shared by every body of the seed, drawn from a stream no body draws from
+		FPhiloxRandom LayoutRandom(Seed, 0, LayoutSubStream);
+		TArray<FVector2f, TInlineAllocator<NumClusters>> ClusterCenters;
+		TArray<float, TInlineAllocator<NumClusters>> ClusterScales;
+		if (Distribution == EBodyDistribution::Clustered)
+		{
+			for (int Cluster = 0; Cluster < NumClusters; Cluster++)
+			{
+				ClusterCenters.Add(RandomLocation(Bounds, LayoutRandom));
+				ClusterScales.Add(Scale * ClusterScale);
+			}
+		}
+		else if (Distribution == EBodyDistribution::Merger)
+		{
+			// Evenly spaced around the center, from a random phase, so no two spheres start on top of each other
+			const float Phase = UE_TWO_PI * LayoutRandom.GetFraction();
+			for (int Cluster = 0; Cluster < NumMergerClusters; Cluster++)
+			{
+				const float Angle = Phase + UE_TWO_PI * Cluster / NumMergerClusters;
+				const FVector2f Direction(FMath::Cos(Angle), FMath::Sin(Angle));
+				ClusterCenters.Add(Center + Direction * (Scale * MergerSeparation));
+				ClusterScales.Add(Scale * PlummerScale * LayoutRandom.FRandRange(0.5f, 1.f));
+			}
+		}
+
+		const int FirstBody = OutBodies.AddZeroed(NumBodies);
+		const int NumChunks = FMath::DivideAndRoundUp(NumBodies, GenerateChunkSize);
+		ParallelFor(NumChunks, [&](const int Chunk)
+		{
+			const int ChunkEnd = FirstBody + FMath::Min(NumBodies, (Chunk + 1) * GenerateChunkSize);
+			for (int BodyIndex = FirstBody + Chunk * GenerateChunkSize; BodyIndex < ChunkEnd; BodyIndex++)
+			{
+				FPhiloxRandom Random(Seed, BodyIndex, BodySubStream);
+
+				FVector2f Location;
+				do
+				{
+					switch (Distribution)
+					{
+					case EBodyDistribution::Clustered:
+						{
+							const int Cluster = Random.RandHelper(NumClusters);
+							Location = ClusterCenters[Cluster] + RandomGaussian(Random) * ClusterScales[Cluster];
+							break;
+						}
+					case EBodyDistribution::Plummer:
+						Location = Center + RandomPlummer(Random) * (Scale * PlummerScale);
+						break;
+					case EBodyDistribution::ExponentialDisk:
+						Location = Center + RandomExponentialDisk(Random) * (Scale * DiskScale);
+						break;
+					case EBodyDistribution::Merger:
+						{
+							const int Cluster = Random.RandHelper(NumMergerClusters);
+							Location = ClusterCenters[Cluster] + RandomPlummer(Random) * ClusterScales[Cluster];
+							break;
+						}
+					default:
+						Location = RandomLocation(Bounds, Random);
+						break;
+					}
+				}
+				// Resample the tails instead of clamping them, clamping would pile bodies up on the bounds' edges
+				while (!Bounds.IsWithinBounds(Location));
+
+				OutBodies.X[BodyIndex] = Location.X;
+				OutBodies.Y[BodyIndex] = Location.Y;
+				OutBodies.Mass[BodyIndex] = Random.FRandRange(MinMass, MaxMass);
+			}
+		});
+	}
+
+	static const TCHAR* ToString(const EBodyDistribution Distribution)
+	{
+		switch (Distribution)
+		{
+		case EBodyDistribution::Clustered:
+			return TEXT("Clustered");
+		case EBodyDistribution::Plummer:
+			return TEXT("Plummer");
+		case EBodyDistribution::ExponentialDisk:
+			return TEXT("ExponentialDisk");
+		case EBodyDistribution::Merger:
+			return TEXT("Merger");
+		default:
+			return TEXT("Uniform");
+		}
+	}
+
+	/**
+	 * @return False if Name isn't the name of a distribution, OutDistribution is left untouched
+	 */
+	static bool FromString(const FString& Name, EBodyDistribution& OutDistribution)
+	{
+		for (const EBodyDistribution Distribution :
+		     {EBodyDistribution::Uniform, EBodyDistribution::Clustered, EBodyDistribution::Plummer,
+		      EBodyDistribution::ExponentialDisk, EBodyDistribution::Merger})
+		{
+			if (Name.Equals(ToString(Distribution), ESearchCase::IgnoreCase))
+			{
+				OutDistribution = Distribution;
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	// Sub streams of the seed, bodies' streams are indexed by spawn index, the layout's by 0
+	static constexpr uint32 BodySubStream = 0;
+	static constexpr uint32 LayoutSubStream = 1;
+
+	static FORCEINLINE FVector2f RandomLocation(const FQuadrantBounds& Bounds, FPhiloxRandom& Random)
+	{
+		return FVector2f(Random.FRandRange(Bounds.Left, Bounds.Right), Random.FRandRange(Bounds.Top, Bounds.Bottom));
+	}
+
+	/**
+	 * @brief Standard normal 2D offset, Box-Muller.
+	 */
+	static FORCEINLINE FVector2f RandomGaussian(FPhiloxRandom& Random)
+	{
+		const float Radius = FMath::Sqrt(-2.f * FMath::Loge(FMath::Max(Random.GetFraction(), UE_SMALL_NUMBER)));
+		const float Angle = UE_TWO_PI * Random.GetFraction();
+		return FVector2f(FMath::Cos(Angle), FMath::Sin(Angle)) * Radius;
+	}
+
+	/**
+	 * @brief Offset from the center of a unit scale Plummer sphere, projected onto the plane.
+	 */
+	static FORCEINLINE FVector2f RandomPlummer(FPhiloxRandom& Random)
+	{
+		// Inverse of the Plummer cumulative mass profile, M(r) = r^3 / (1 + r^2)^(3/2)
+		const float MassFraction = FMath::Clamp(Random.GetFraction(), UE_SMALL_NUMBER, 1.f - UE_SMALL_NUMBER);
+		const float Radius = 1.f / FMath::Sqrt(FMath::Pow(MassFraction, -2.f / 3.f) - 1.f);
+
+		// Uniform direction on the sphere, only the planar part is kept
+		const float CosTheta = Random.FRandRange(-1.f, 1.f);
+		const float SinTheta = FMath::Sqrt(1.f - CosTheta * CosTheta);
+		const float Phi = UE_TWO_PI * Random.GetFraction();
+		return FVector2f(FMath::Cos(Phi), FMath::Sin(Phi)) * (Radius * SinTheta);
+	}
+
+	/**
+	 * @brief Offset from the center of a unit scale length exponential disk.
+	 */
+	static FORCEINLINE FVector2f RandomExponentialDisk(FPhiloxRandom& Random)
+	{
+		// Mass within a ring grows as R * exp(-R), a gamma distribution of shape 2, so the radius is the sum of two
+		// unit exponential draws
+		const float Product = FMath::Max(Random.GetFraction() * Random.GetFraction(), UE_SMALL_NUMBER);
+		const float Radius = -FMath::Loge(Product);
+		const float Angle = UE_TWO_PI * Random.GetFraction();
+		return FVector2f(FMath::Cos(Angle), FMath::Sin(Angle)) * Radius;
+	}
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include "Math/VectorRegister.h"
+#include "Core/DataStructure/BodyArray.h"
+#include "Core/Threading/FWorkStealingScheduler.h"
+
+/**
+ * @brief Exact O(N^2) force pass, for scenes too small for the tree to pay for itself.
+ * Bodies are split into tiles small enough for two of them & their accumulators to stay in L1, and every tile pair on
+ * or above the diagonal is one work item. Every body pair is evaluated once and applied to both bodies, so each worker
+ * accumulates into its own velocity buffers, summed into the bodies once all pairs are done.
+ * Within a tile pair RowBlockSize bodies are kept in registers while the column tile streams through 4 lanes at a
+ * time, so the column accumulators are only loaded & stored once per row block.
+ */
+class FDirectForceSolver
+{
+public:
+	// 3 streams of 256 floats per tile, plus the column accumulators, stays well within L1
+	static constexpr int TileSize = 256;
+	static constexpr int RowBlockSize = 4;
+
+private:
+	struct FWorkerAccumulators
+	{
+		FBodyArray::FStream VX;
+		FBodyArray::FStream VY;
+	};
+
+	TArray<FWorkerAccumulators> WorkerAccumulators;
+
+	// Row & column tile of every work item, row major
+	TArray<TPair<int, int>> TilePairs;
+
+public:
+	/**
+	 * @brief Adds the velocity change every body applies to every other body, and sets every body's cost to its
+	 * number of interactions.
+	 */
+	void Solve(FBodyArray& Bodies, FWorkStealingScheduler& Scheduler)
+	{
+		const int NumBodies = Bodies.Num();
+		if (NumBodies < 2)
+			return;
+
+		const int NumTiles = FMath::DivideAndRoundUp(NumBodies, TileSize);
+		TilePairs.Reset(NumTiles * (NumTiles + 1) / 2);
+		for (int RowTile = 0; RowTile < NumTiles; RowTile++)
+		{
+			for (int ColTile = RowTile; ColTile < NumTiles; ColTile++)
+				TilePairs.Emplace(RowTile, ColTile);
+		}
+
+		WorkerAccumulators.SetNum(Scheduler.GetNumWorkers());
+		::ParallelFor(WorkerAccumulators.Num(), [this, NumBodies](const int WorkerIndex)
+		{
+			FWorkerAccumulators& Accumulators = WorkerAccumulators[WorkerIndex];
+			Accumulators.VX.SetNumUninitialized(NumBodies);
+			Accumulators.VY.SetNumUninitialized(NumBodies);
+			FMemory::Memzero(Accumulators.VX.GetData(), NumBodies * sizeof(float));
+			FMemory::Memzero(Accumulators.VY.GetData(), NumBodies * sizeof(float));
+		});
+
+		const float* RESTRICT X = Bodies.X.GetData();
+		const float* RESTRICT Y = Bodies.Y.GetData();
+		const float* RESTRICT Mass = Bodies.Mass.GetData();
+
+		// Off diagonal pairs all cost the same, diagonal ones half, stealing evens that out
+		Scheduler.ParallelFor(TilePairs.Num(), 1, [&](const int Start, const int End, const int WorkerIndex)
+		{
+			FWorkerAccumulators& Accumulators = WorkerAccumulators[WorkerIndex];
+			for (int PairIndex = Start; PairIndex < End; PairIndex++)
+			{
+				const int RowStart = TilePairs[PairIndex].Key * TileSize;
+				const int ColStart = TilePairs[PairIndex].Value * TileSize;
+				EvaluateTilePair(X, Y, Mass, Accumulators.VX.GetData(), Accumulators.VY.GetData(), RowStart,
+				                 FMath::Min(RowStart + TileSize, NumBodies), ColStart,
+				                 FMath::Min(ColStart + TileSize, NumBodies));
+			}
+		});
+
+		// Sum every worker's share into the bodies
+		const int NumChunks = FMath::DivideAndRoundUp(NumBodies, TileSize);
+		::ParallelFor(NumChunks, [this, &Bodies, NumBodies](const int Chunk)
+		{
+			const int ChunkEnd = FMath::Min(NumBodies, (Chunk + 1) * TileSize);
+			for (const FWorkerAccumulators& Accumulators : WorkerAccumulators)
+			{
+				for (int i = Chunk * TileSize; i < ChunkEnd; i++)
+				{
+					Bodies.VX[i] += Accumulators.VX[i];
+					Bodies.VY[i] += Accumulators.VY[i];
+				}
+			}
+
+			for (int i = Chunk * TileSize; i < ChunkEnd; i++)
+				Bodies.Cost[i] = NumBodies - 1;
+		});
+	}
+
+private:
+	static void EvaluateTilePair(const float* RESTRICT X, const float* RESTRICT Y, const float* RESTRICT Mass,
+	                             float* RESTRICT VX, float* RESTRICT VY, const int RowStart, const int RowEnd,
+	                             const int ColStart, const int ColEnd)
+	{
+		const bool bIsDiagonal = RowStart == ColStart;
+
+		for (int Row = RowStart; Row < RowEnd; Row += RowBlockSize)
+		{
+			const int BlockEnd = FMath::Min(Row + RowBlockSize, RowEnd);
+
+			// On the diagonal only the pairs above it are evaluated, the block's own triangle first so the columns
+			// after it start on a lane boundary
+			int BlockColStart = ColStart;
+			if (bIsDiagonal)
+			{
+				for (int i = Row; i < BlockEnd; i++)
+				{
+					for (int j = i + 1; j < BlockEnd; j++)
+						EvaluatePair(X, Y, Mass, VX, VY, i, j);
+				}
+				BlockColStart = BlockEnd;
+			}
+
+			if (BlockEnd - Row == RowBlockSize)
+			{
+				EvaluateRowBlock<RowBlockSize>(X, Y, Mass, VX, VY, Row, BlockColStart, ColEnd);
+			}
+			else
+			{
+				for (int i = Row; i < BlockEnd; i++)
+					EvaluateRowBlock<1>(X, Y, Mass, VX, VY, i, BlockColStart, ColEnd);
+			}
+		}
+	}
+
+	/**
+	 * @brief Evaluates rows [Row, Row + NumRows) against columns [ColStart, ColEnd), ColStart must be a multiple of 4.
+	 */
+	template<int NumRows>
+	static FORCEINLINE void EvaluateRowBlock(const float* RESTRICT X, const float* RESTRICT Y,
+	                                         const float* RESTRICT Mass, float* RESTRICT VX, float* RESTRICT VY,
+	                                         const int Row, const int ColStart, const int ColEnd)
+	{
+		VectorRegister4Float RowX[NumRows];
+		VectorRegister4Float RowY[NumRows];
+		VectorRegister4Float RowMass[NumRows];
+		VectorRegister4Float RowAccumX[NumRows];
+		VectorRegister4Float RowAccumY[NumRows];
+		for (int r = 0; r < NumRows; r++)
+		{
+			RowX[r] = VectorSetFloat1(X[Row + r]);
+			RowY[r] = VectorSetFloat1(Y[Row + r]);
+			RowMass[r] = VectorSetFloat1(Mass[Row + r]);
+			RowAccumX[r] = VectorZeroFloat();
+			RowAccumY[r] = VectorZeroFloat();
+		}
+
+		// Streams & accumulators are 32 byte aligned and Col only ever advances in multiples of the lane width
+		int Col = ColStart;
+		for (; Col + 4 <= ColEnd; Col += 4)
+		{
+			const VectorRegister4Float ColX = VectorLoadAligned(X + Col);
+			const VectorRegister4Float ColY = VectorLoadAligned(Y + Col);
+			const VectorRegister4Float ColMass = VectorLoadAligned(Mass + Col);
+			VectorRegister4Float ColAccumX = VectorZeroFloat();
+			VectorRegister4Float ColAccumY = VectorZeroFloat();
+
+			for (int r = 0; r < NumRows; r++)
+			{
+				const VectorRegister4Float DistX = VectorSubtract(ColX, RowX[r]);
+				const VectorRegister4Float DistY = VectorSubtract(ColY, RowY[r]);
+				const VectorRegister4Float SquaredLength = VectorMultiplyAdd(DistX, DistX, VectorMultiply(DistY, DistY));
+				const VectorRegister4Float InvSquaredLength = VectorDivide(VectorOneFloat(), SquaredLength);
+
+				// Same distance pulls the row body towards the column body & the other way around
+				const VectorRegister4Float RowScale = VectorMultiply(ColMass, InvSquaredLength);
+				const VectorRegister4Float ColScale = VectorMultiply(RowMass[r], InvSquaredLength);
+				RowAccumX[r] = VectorMultiplyAdd(DistX, RowScale, RowAccumX[r]);
+				RowAccumY[r] = VectorMultiplyAdd(DistY, RowScale, RowAccumY[r]);
+				ColAccumX = VectorMultiplyAdd(DistX, ColScale, ColAccumX);
+				ColAccumY = VectorMultiplyAdd(DistY, ColScale, ColAccumY);
+			}
+
+			VectorStoreAligned(VectorSubtract(VectorLoadAligned(VX + Col), ColAccumX), VX + Col);
+			VectorStoreAligned(VectorSubtract(VectorLoadAligned(VY + Col), ColAccumY), VY + Col);
+		}
+
+		for (int r = 0; r < NumRows; r++)
+		{
+			alignas(16) float SumX[4];
+			alignas(16) float SumY[4];
+			VectorStoreAligned(RowAccumX[r], SumX);
+			VectorStoreAligned(RowAccumY[r], SumY);
+			VX[Row + r] += SumX[0] + SumX[1] + SumX[2] + SumX[3];
+			VY[Row + r] += SumY[0] + SumY[1] + SumY[2] + SumY[3];
+
+			for (int j = Col; j < ColEnd; j++)
+				EvaluatePair(X, Y, Mass, VX, VY, Row + r, j);
+		}
+	}
+
+	static FORCEINLINE void EvaluatePair(const float* RESTRICT X, const float* RESTRICT Y, const float* RESTRICT Mass,
+	                                     float* RESTRICT VX, float* RESTRICT VY, const int i, const int j)
+	{
+		const FVector2f Dist = FVector2f(X[j] - X[i], Y[j] - Y[i]);
+		const float InvSquaredLength = 1.f / Dist.SquaredLength();
+
+		VX[i] += Dist.X * (Mass[j] * InvSquaredLength);
+		VY[i] += Dist.Y * (Mass[j] * InvSquaredLength);
+		VX[j] -= Dist.X * (Mass[i] * InvSquaredLength);
+		VY[j] -= Dist.Y * (Mass[i] * InvSquaredLength);
+	}
+};
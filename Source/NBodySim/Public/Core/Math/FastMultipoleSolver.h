@@ -0,0 +1,470 @@
+#pragma once
+#include "Core/DataStructure/BodyArray.h"
+#include "Core/DataStructure/MortonCode.h"
+#include "Async/ParallelFor.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/**
+ * @brief Fast multipole method over a uniform quad tree, in 2D complex form.
+ * The force law is the gradient of a logarithmic potential, so with complex Z the velocity change of a body at Z is
+ * -conj(G(Z)), G(Z) = Sum(m / (Z - S)) over every other body at S. Each box's far field is carried as the multipole
+ * expansion Sum(A_k / (Z - C)^(k + 1)) of G about its center, each box's incoming field as the local expansion
+ * Sum(B_l * (Z - C)^l), both truncated to Order.
+ * Boxes follow the same quadrant subdivision as TBarnesHutTree, but every level is complete and indexed by Morton key,
+ * so a box's children are the 4 boxes at 4 * Key and its neighbours are found from its coordinates, no pointers.
+ * P2M -> M2M runs up the levels, M2L + L2L down the levels, then L2P & direct P2P with the neighbouring leaves, every
+ * pass in parallel over the boxes of one level on the task graph. Coordinates are scaled to the unit square and
+ * expansions kept in double so high orders neither overflow nor lose the small coefficients.
+ */
+class FFastMultipoleSolver
+{
+public:
+	static constexpr int MaxOrder = 32;
+
+	// 4^10 leaf boxes, far beyond any body count a step can afford
+	static constexpr int MaxLevel = 10;
+
+private:
+	struct FComplex
+	{
+		double Re = 0;
+		double Im = 0;
+
+		FComplex() = default;
+
+		FORCEINLINE FComplex(const double Re, const double Im = 0) : Re(Re), Im(Im)
+		{
+		}
+
+		FORCEINLINE FComplex operator+(const FComplex& Other) const { return FComplex(Re + Other.Re, Im + Other.Im); }
+		FORCEINLINE FComplex operator-(const FComplex& Other) const { return FComplex(Re - Other.Re, Im - Other.Im); }
+		FORCEINLINE FComplex operator*(const double Scale) const { return FComplex(Re * Scale, Im * Scale); }
+
+		FORCEINLINE FComplex operator*(const FComplex& Other) const
+		{
+			return FComplex(Re * Other.Re - Im * Other.Im, Re * Other.Im + Im * Other.Re);
+		}
+
+		FORCEINLINE FComplex& operator+=(const FComplex& Other)
+		{
+			Re += Other.Re;
+			Im += Other.Im;
+			return *this;
+		}
+
+		FORCEINLINE FComplex Reciprocal() const
+		{
+			const double InvSquaredLength = 1.0 / (Re * Re + Im * Im);
+			return FComplex(Re * InvSquaredLength, -Im * InvSquaredLength);
+		}
+	};
+
+	int Order = 10;
+	int LeafSize = 32;
+
+	// Deepest level, the leaves, the root being level 0
+	int LeafLevel = 2;
+
+	// Square the boxes subdivide, the bounds' top left corner & longest side
+	FVector2D Origin = FVector2D::ZeroVector;
+	double Side = 1;
+
+	// Order + 1 coefficients per box, boxes in Morton order, one array per level
+	TArray<TArray<FComplex>> Multipoles;
+	TArray<TArray<FComplex>> Locals;
+
+	// Bodies sorted by leaf box, every leaf box owns the contiguous range starting at its LeafStarts entry
+	TArray<uint32> BodyLeafKeys;
+	TArray<int> LeafStarts;
+	TArray<int> SortedBodyIndices;
+	FBodyArray::FStream SortedX;
+	FBodyArray::FStream SortedY;
+	FBodyArray::FStream SortedMass;
+
+	// Binomial coefficient C(N, K) at N * BinomialStride + K, up to the M2L's 2 * MaxOrder
+	static constexpr int BinomialStride = 2 * MaxOrder + 1;
+	TArray<double> Binomials;
+
+public:
+	FFastMultipoleSolver()
+	{
+		Binomials.SetNumZeroed(BinomialStride * BinomialStride);
+		for (int N = 0; N < BinomialStride; N++)
+		{
+			Binomials[N * BinomialStride] = 1;
+			for (int K = 1; K <= N; K++)
+				Binomials[N * BinomialStride + K] = Binomials[(N - 1) * BinomialStride + K - 1] +
+					(K < N ? Binomials[(N - 1) * BinomialStride + K] : 0);
+		}
+	}
+
+	/**
+	 * @brief Sets the number of expansion terms past the monopole, applied on the next solve.
+	 */
+	FORCEINLINE void SetOrder(const int InOrder) { Order = FMath::Clamp(InOrder, 1, MaxOrder); }
+
+	/**
+	 * @brief Sets the average number of bodies per leaf box the leaf level is picked for, applied on the next solve.
+	 */
+	FORCEINLINE void SetLeafSize(const int InLeafSize) { LeafSize = FMath::Max(InLeafSize, 1); }
+
+	/**
+	 * @brief Depth of the leaf level, the root being at depth 0.
+	 */
+	FORCEINLINE int GetDepth() const { return LeafLevel; }
+
+	/**
+	 * @brief Number of boxes over every level of the last solve.
+	 */
+	int NumBoxes() const
+	{
+		int Num = 0;
+		for (int Level = 0; Level < Multipoles.Num(); Level++)
+			Num += 1 << (2 * Level);
+		return Num;
+	}
+
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		for (int Level = 0; Level < Multipoles.Num(); Level++)
+		{
+			Footprint.Add(Multipoles[Level]);
+			Footprint.Add(Locals[Level]);
+		}
+		Footprint.Add(BodyLeafKeys);
+		Footprint.Add(LeafStarts);
+		Footprint.Add(SortedBodyIndices);
+		Footprint.Add(SortedX);
+		Footprint.Add(SortedY);
+		Footprint.Add(SortedMass);
+		Footprint.Add(Binomials);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Adds the velocity change every body applies to every other body, and sets every body's cost to its
+	 * number of direct near field interactions.
+	 * @param Bodies Bodies to update, must be within Bounds
+	 * @param Bounds Bounds the boxes subdivide
+	 * @return The total number of direct near field interactions
+	 */
+	int64 Solve(FBodyArray& Bodies, const FQuadrantBounds& Bounds)
+	{
+		const int NumBodies = Bodies.Num();
+		if (NumBodies < 2)
+			return 0;
+
+		Origin = FVector2D(Bounds.Left, Bounds.Top);
+		Side = FMath::Max(Bounds.HorizontalSize(), Bounds.VerticalSize());
+
+		// Interaction lists only exist from level 2 on
+		const double NumLeafBoxesWanted = StaticCast<double>(NumBodies) / LeafSize;
+		LeafLevel = FMath::Clamp(FMath::CeilToInt(FMath::LogX(4.0, FMath::Max(NumLeafBoxesWanted, 1.0))), 2, MaxLevel);
+
+		Multipoles.SetNum(LeafLevel + 1);
+		Locals.SetNum(LeafLevel + 1);
+		for (int Level = 0; Level <= LeafLevel; Level++)
+		{
+			Multipoles[Level].SetNumUninitialized((1 << (2 * Level)) * (Order + 1));
+			Locals[Level].SetNumUninitialized((1 << (2 * Level)) * (Order + 1));
+		}
+
+		SortBodies(Bodies);
+		ParticlesToMultipoles();
+		MultipolesToMultipoles();
+		MultipolesToLocals();
+		return LocalsToParticles(Bodies);
+	}
+
+private:
+	FORCEINLINE double Binomial(const int N, const int K) const { return Binomials[N * BinomialStride + K]; }
+
+	/**
+	 * @brief Center of a box in the unit square.
+	 */
+	static FORCEINLINE FComplex GetBoxCenter(const uint32 Key, const int Level)
+	{
+		uint32 X, Y;
+		FMortonCode::Decode(Key, X, Y);
+		const double BoxSize = 1.0 / (1 << Level);
+		return FComplex((X + 0.5) * BoxSize, (Y + 0.5) * BoxSize);
+	}
+
+	FORCEINLINE FComplex ToUnitSquare(const float X, const float Y) const
+	{
+		return FComplex((X - Origin.X) / Side, (Y - Origin.Y) / Side);
+	}
+
+	/**
+	 * @brief Counting sort of the bodies by leaf box.
+	 */
+	void SortBodies(const FBodyArray& Bodies)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FFastMultipoleSolver::SortBodies);
+
+		const int NumBodies = Bodies.Num();
+		const int BoxesPerAxis = 1 << LeafLevel;
+		const int NumLeafBoxes = BoxesPerAxis * BoxesPerAxis;
+
+		BodyLeafKeys.SetNumUninitialized(NumBodies);
+		::ParallelFor(NumBodies, [&](const int i)
+		{
+			const FComplex Location = ToUnitSquare(Bodies.X[i], Bodies.Y[i]);
+			BodyLeafKeys[i] = FMortonCode::Encode(
+				FMath::Clamp(FMath::FloorToInt32(Location.Re * BoxesPerAxis), 0, BoxesPerAxis - 1),
+				FMath::Clamp(FMath::FloorToInt32(Location.Im * BoxesPerAxis), 0, BoxesPerAxis - 1));
+		});
+
+		LeafStarts.SetNumUninitialized(NumLeafBoxes + 1);
+		FMemory::Memzero(LeafStarts.GetData(), LeafStarts.Num() * sizeof(int));
+		for (int i = 0; i < NumBodies; i++)
+			++LeafStarts[BodyLeafKeys[i] + 1];
+		for (int Box = 0; Box < NumLeafBoxes; Box++)
+			LeafStarts[Box + 1] += LeafStarts[Box];
+
+		SortedBodyIndices.SetNumUninitialized(NumBodies);
+		TArray<int> Cursors(LeafStarts.GetData(), NumLeafBoxes);
+		for (int i = 0; i < NumBodies; i++)
+			SortedBodyIndices[Cursors[BodyLeafKeys[i]]++] = i;
+
+		SortedX.SetNumUninitialized(NumBodies);
+		SortedY.SetNumUninitialized(NumBodies);
+		SortedMass.SetNumUninitialized(NumBodies);
+		::ParallelFor(NumBodies, [&](const int i)
+		{
+			const int BodyIndex = SortedBodyIndices[i];
+			SortedX[i] = Bodies.X[BodyIndex];
+			SortedY[i] = Bodies.Y[BodyIndex];
+			SortedMass[i] = Bodies.Mass[BodyIndex];
+		});
+	}
+
+	/**
+	 * @brief P2M, A_k = Sum(m * W^k) over the offsets W of a leaf's bodies from its center.
+	 */
+	void ParticlesToMultipoles()
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FFastMultipoleSolver::P2M);
+
+		::ParallelFor(1 << (2 * LeafLevel), [&](const int Box)
+		{
+			FComplex* Multipole = &Multipoles[LeafLevel][Box * (Order + 1)];
+			for (int k = 0; k <= Order; k++)
+				Multipole[k] = FComplex();
+
+			const FComplex Center = GetBoxCenter(Box, LeafLevel);
+			for (int i = LeafStarts[Box]; i < LeafStarts[Box + 1]; i++)
+			{
+				const FComplex Offset = ToUnitSquare(SortedX[i], SortedY[i]) - Center;
+				FComplex Power(SortedMass[i]);
+				for (int k = 0; k <= Order; k++)
+				{
+					Multipole[k] += Power;
+					Power = Power * Offset;
+				}
+			}
+		});
+	}
+
+	/**
+	 * @brief M2M, shifts the children's expansions to their parent's center, A'_k = Sum(C(k, j) * D^(k - j) * A_j).
+	 */
+	void MultipolesToMultipoles()
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FFastMultipoleSolver::M2M);
+
+		for (int Level = LeafLevel - 1; Level >= 2; Level--)
+		{
+			::ParallelFor(1 << (2 * Level), [&](const int Box)
+			{
+				FComplex* Multipole = &Multipoles[Level][Box * (Order + 1)];
+				for (int k = 0; k <= Order; k++)
+					Multipole[k] = FComplex();
+
+				const FComplex Center = GetBoxCenter(Box, Level);
+				for (int ChildIndex = 0; ChildIndex < 4; ChildIndex++)
+				{
+					const uint32 Child = Box * 4 + ChildIndex;
+					const FComplex* ChildMultipole = &Multipoles[Level + 1][Child * (Order + 1)];
+					if (ChildMultipole[0].Re == 0)
+						continue;
+
+					FComplex Powers[MaxOrder + 1];
+					FillPowers(GetBoxCenter(Child, Level + 1) - Center, Powers, Order);
+
+					for (int k = 0; k <= Order; k++)
+					{
+						for (int j = 0; j <= k; j++)
+							Multipole[k] += ChildMultipole[j] * Powers[k - j] * Binomial(k, j);
+					}
+				}
+			});
+		}
+	}
+
+	/**
+	 * @brief M2L & L2L level by level from the top, every box pulls its parent's local expansion shifted to its own
+	 * center, B'_j = Sum(C(l, j) * E^(l - j) * B_l), then adds the expansions of its interaction list,
+	 * B_l = (-1)^l * Sum(C(k + l, l) * A_k / D^(k + l + 1)).
+	 */
+	void MultipolesToLocals()
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FFastMultipoleSolver::M2L);
+
+		for (int Level = 2; Level <= LeafLevel; Level++)
+		{
+			const int BoxesPerAxis = 1 << Level;
+			::ParallelFor(BoxesPerAxis * BoxesPerAxis, [&](const int Box)
+			{
+				FComplex* Local = &Locals[Level][Box * (Order + 1)];
+				for (int l = 0; l <= Order; l++)
+					Local[l] = FComplex();
+
+				const FComplex Center = GetBoxCenter(Box, Level);
+
+				if (Level > 2)
+				{
+					const uint32 Parent = Box >> 2;
+					const FComplex* ParentLocal = &Locals[Level - 1][Parent * (Order + 1)];
+
+					FComplex Powers[MaxOrder + 1];
+					FillPowers(Center - GetBoxCenter(Parent, Level - 1), Powers, Order);
+
+					for (int j = 0; j <= Order; j++)
+					{
+						for (int l = j; l <= Order; l++)
+							Local[j] += ParentLocal[l] * Powers[l - j] * Binomial(l, j);
+					}
+				}
+
+				// Children of the parent's neighbours that aren't neighbours of this box
+				uint32 X, Y;
+				FMortonCode::Decode(Box, X, Y);
+				const int ParentX = X >> 1;
+				const int ParentY = Y >> 1;
+				const int NumParents = BoxesPerAxis >> 1;
+
+				for (int NeighbourY = FMath::Max(ParentY - 1, 0); NeighbourY <= FMath::Min(ParentY + 1, NumParents - 1);
+				     NeighbourY++)
+				{
+					for (int NeighbourX = FMath::Max(ParentX - 1, 0);
+					     NeighbourX <= FMath::Min(ParentX + 1, NumParents - 1); NeighbourX++)
+					{
+						for (int ChildIndex = 0; ChildIndex < 4; ChildIndex++)
+						{
+							const int SourceX = NeighbourX * 2 + (ChildIndex & 1);
+							const int SourceY = NeighbourY * 2 + (ChildIndex >> 1);
+							if (FMath::Abs(SourceX - StaticCast<int>(X)) <= 1 &&
+								FMath::Abs(SourceY - StaticCast<int>(Y)) <= 1)
+								continue;
+
+							const uint32 Source = FMortonCode::Encode(SourceX, SourceY);
+							const FComplex* Multipole = &Multipoles[Level][Source * (Order + 1)];
+							if (Multipole[0].Re == 0)
+								continue;
+
+							AddMultipoleToLocal(Multipole, Center - GetBoxCenter(Source, Level), Local);
+						}
+					}
+				}
+			});
+		}
+	}
+
+	FORCEINLINE void AddMultipoleToLocal(const FComplex* Multipole, const FComplex Dist, FComplex* Local) const
+	{
+		FComplex InvPowers[2 * MaxOrder + 2];
+		FillPowers(Dist.Reciprocal(), InvPowers, 2 * Order + 1);
+
+		for (int l = 0; l <= Order; l++)
+		{
+			FComplex Sum;
+			for (int k = 0; k <= Order; k++)
+				Sum += Multipole[k] * InvPowers[k + l + 1] * Binomial(k + l, l);
+
+			Local[l] += (l & 1) ? Sum * -1.0 : Sum;
+		}
+	}
+
+	/**
+	 * @brief L2P & P2P, evaluates every leaf's local expansion at its bodies and adds the neighbouring leaves' bodies
+	 * directly.
+	 * @return The total number of direct interactions
+	 */
+	int64 LocalsToParticles(FBodyArray& Bodies)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FFastMultipoleSolver::L2P);
+
+		const int BoxesPerAxis = 1 << LeafLevel;
+		const double InvSide = 1.0 / Side;
+		std::atomic<int64> NumDirectInteractions{0};
+
+		::ParallelFor(BoxesPerAxis * BoxesPerAxis, [&](const int Box)
+		{
+			const int BoxStart = LeafStarts[Box];
+			const int BoxEnd = LeafStarts[Box + 1];
+			if (BoxStart == BoxEnd)
+				return;
+
+			const FComplex* Local = &Locals[LeafLevel][Box * (Order + 1)];
+			const FComplex Center = GetBoxCenter(Box, LeafLevel);
+
+			uint32 BoxX, BoxY;
+			FMortonCode::Decode(Box, BoxX, BoxY);
+			const int X = BoxX;
+			const int Y = BoxY;
+			int64 NumBoxInteractions = 0;
+
+			for (int i = BoxStart; i < BoxEnd; i++)
+			{
+				const FVector2f Location(SortedX[i], SortedY[i]);
+
+				// Far field, Horner on the local expansion, then back from the unit square & into a velocity
+				const FComplex Offset = ToUnitSquare(Location.X, Location.Y) - Center;
+				FComplex Field = Local[Order];
+				for (int l = Order - 1; l >= 0; l--)
+					Field = Field * Offset + Local[l];
+
+				FVector2f Velocity(StaticCast<float>(-Field.Re * InvSide), StaticCast<float>(Field.Im * InvSide));
+
+				// Near field, every body of this leaf & the adjacent ones
+				int NumNear = 0;
+				for (int NeighbourY = FMath::Max(Y - 1, 0); NeighbourY <= FMath::Min(Y + 1, BoxesPerAxis - 1);
+				     NeighbourY++)
+				{
+					for (int NeighbourX = FMath::Max(X - 1, 0); NeighbourX <= FMath::Min(X + 1, BoxesPerAxis - 1);
+					     NeighbourX++)
+					{
+						const uint32 Neighbour = FMortonCode::Encode(NeighbourX, NeighbourY);
+						for (int j = LeafStarts[Neighbour]; j < LeafStarts[Neighbour + 1]; j++)
+						{
+							if (j == i)
+								continue;
+
+							const FVector2f Dist = FVector2f(SortedX[j], SortedY[j]) - Location;
+							Velocity += Dist * (SortedMass[j] / Dist.SquaredLength());
+							++NumNear;
+						}
+					}
+				}
+
+				const int BodyIndex = SortedBodyIndices[i];
+				Bodies.SetVelocity(BodyIndex, Bodies.GetVelocity(BodyIndex) + Velocity);
+				Bodies.Cost[BodyIndex] = NumNear;
+				NumBoxInteractions += NumNear;
+			}
+
+			NumDirectInteractions.fetch_add(NumBoxInteractions, std::memory_order_relaxed);
+		});
+
+		return NumDirectInteractions.load();
+	}
+
+	static FORCEINLINE void FillPowers(const FComplex Value, FComplex* OutPowers, const int MaxPower)
+	{
+		OutPowers[0] = FComplex(1);
+		for (int Power = 1; Power <= MaxPower; Power++)
+			OutPowers[Power] = OutPowers[Power - 1] * Value;
+	}
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "Math/VectorRegister.h"
+#include "Core/DataStructure/InteractionList.h"
+
+#if PLATFORM_ALWAYS_HAS_AVX
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Evaluates interaction lists several lanes at a time.
+ * The widest path available at compile time is used: 8 lanes when the target always has AVX, otherwise 4 lanes
+ * through UE's VectorRegister4Float, which maps to SSE or NEON. Whatever doesn't fill a vector goes through the
+ * scalar path, which matches UNBodySimulationSubsystem::CalculateBodyVelocity.
+ */
+struct FForceKernel
+{
+#if PLATFORM_ALWAYS_HAS_AVX
+	static constexpr int LaneWidth = 8;
+#else
+	static constexpr int LaneWidth = 4;
+#endif
+
+	/**
+	 * @brief Sums the velocity change every entry of the list applies to a body at Location.
+	 * The list must not contain the body itself.
+	 */
+	static FVector2f Evaluate(const FVector2f Location, const FInteractionList& Interactions)
+	{
+		const int Num = Interactions.Num();
+		const float* RESTRICT X = Interactions.X.GetData();
+		const float* RESTRICT Y = Interactions.Y.GetData();
+		const float* RESTRICT Mass = Interactions.Mass.GetData();
+
+		FVector2f Velocity(0);
+		int Index = 0;
+
+#if PLATFORM_ALWAYS_HAS_AVX
+		Velocity += EvaluateAVX(Location, X, Y, Mass, Num, Index);
+#endif
+		Velocity += EvaluateVectorRegister(Location, X, Y, Mass, Num, Index);
+
+		for (; Index < Num; Index++)
+		{
+			const FVector2f Dist = FVector2f(X[Index], Y[Index]) - Location;
+			Velocity += Dist * (Mass[Index] / Dist.SquaredLength());
+		}
+
+		return Velocity;
+	}
+
+private:
+	static FORCEINLINE FVector2f EvaluateVectorRegister(const FVector2f Location, const float* RESTRICT X,
+	                                                    const float* RESTRICT Y, const float* RESTRICT Mass,
+	                                                    const int Num, int& Index)
+	{
+		const VectorRegister4Float BodyX = VectorSetFloat1(Location.X);
+		const VectorRegister4Float BodyY = VectorSetFloat1(Location.Y);
+		VectorRegister4Float AccumX = VectorZeroFloat();
+		VectorRegister4Float AccumY = VectorZeroFloat();
+
+		// Streams are 32 byte aligned and Index only ever advances in multiples of the lane width
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			const VectorRegister4Float DistX = VectorSubtract(VectorLoadAligned(X + Index), BodyX);
+			const VectorRegister4Float DistY = VectorSubtract(VectorLoadAligned(Y + Index), BodyY);
+			const VectorRegister4Float SquaredLength = VectorMultiplyAdd(DistX, DistX, VectorMultiply(DistY, DistY));
+			const VectorRegister4Float Scale = VectorDivide(VectorLoadAligned(Mass + Index), SquaredLength);
+
+			AccumX = VectorMultiplyAdd(DistX, Scale, AccumX);
+			AccumY = VectorMultiplyAdd(DistY, Scale, AccumY);
+		}
+
+		alignas(16) float SumX[4];
+		alignas(16) float SumY[4];
+		VectorStoreAligned(AccumX, SumX);
+		VectorStoreAligned(AccumY, SumY);
+		return FVector2f(SumX[0] + SumX[1] + SumX[2] + SumX[3], SumY[0] + SumY[1] + SumY[2] + SumY[3]);
+	}
+
+#if PLATFORM_ALWAYS_HAS_AVX
+	static FORCEINLINE FVector2f EvaluateAVX(const FVector2f Location, const float* RESTRICT X, const float* RESTRICT Y,
+	                                         const float* RESTRICT Mass, const int Num, int& Index)
+	{
+		const __m256 BodyX = _mm256_set1_ps(Location.X);
+		const __m256 BodyY = _mm256_set1_ps(Location.Y);
+		__m256 AccumX = _mm256_setzero_ps();
+		__m256 AccumY = _mm256_setzero_ps();
+
+		for (; Index + 8 <= Num; Index += 8)
+		{
+			const __m256 DistX = _mm256_sub_ps(_mm256_load_ps(X + Index), BodyX);
+			const __m256 DistY = _mm256_sub_ps(_mm256_load_ps(Y + Index), BodyY);
+			const __m256 SquaredLength = _mm256_add_ps(_mm256_mul_ps(DistX, DistX), _mm256_mul_ps(DistY, DistY));
+			const __m256 Scale = _mm256_div_ps(_mm256_load_ps(Mass + Index), SquaredLength);
+
+			AccumX = _mm256_add_ps(AccumX, _mm256_mul_ps(DistX, Scale));
+			AccumY = _mm256_add_ps(AccumY, _mm256_mul_ps(DistY, Scale));
+		}
+
+		alignas(32) float SumX[8];
+		alignas(32) float SumY[8];
+		_mm256_store_ps(SumX, AccumX);
+		_mm256_store_ps(SumY, AccumY);
+
+		FVector2f Sum(0);
+		for (int Lane = 0; Lane < 8; Lane++)
+			Sum += FVector2f(SumX[Lane], SumY[Lane]);
+		return Sum;
+	}
+#endif
+};
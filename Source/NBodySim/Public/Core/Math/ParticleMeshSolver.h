@@ -0,0 +1,451 @@
+#pragma once
+#include "Core/DataStructure/BodyArray.h"
+#include "Core/DataStructure/TreeWalker.h"
+#include "Async/ParallelFor.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+/**
+ * @brief Particle mesh force pass, for dense & nearly uniform scenes where the whole field is smooth.
+ * Masses are spread on a GridSize x GridSize lattice of nodes spanning the bounds by cloud in cell, the field is the
+ * convolution of that lattice with the pairwise force law, done as a product in Fourier space, then interpolated back
+ * to every body with the same cloud in cell weights, so bodies never pull on themselves & momentum is conserved.
+ * The lattice is zero padded to twice its size, so the convolution doesn't wrap around & the field matches the
+ * isolated scene the other solvers see, rather than a periodic one.
+ * Forces are only resolved down to a few cells. Given a tree, the pass becomes TreePM: the grid only carries the
+ * Gaussian smoothed long range part of the force law, the remaining short range part is summed over a tree walk
+ * culled to a few split radii.
+ * Complex values are FVector2f, X real & Y imaginary, as in TQuadrupoleMoments.
+ */
+class FParticleMeshSolver
+{
+public:
+	static constexpr int MinGridSize = 16;
+	static constexpr int MaxGridSize = 2048;
+
+	// The short range force is below 1e-5 of the full force past this many split radii
+	static constexpr float ShortRangeCutoff = 5;
+
+private:
+	int GridSize = 256;
+
+	// Split radius in cells, only used with a short range tree
+	float SplitScale = 1.25f;
+
+	// Lattice the kernel was built for, rebuilt when any of them changes
+	int KernelGridSize = 0;
+	FVector2f KernelCellSize = FVector2f::ZeroVector;
+	float KernelSplitRadius = -1;
+
+	FVector2f Origin = FVector2f::ZeroVector;
+	FVector2f CellSize = FVector2f(1);
+
+	// Padded size, the FFT length along both axes
+	int PaddedSize = 0;
+
+	// Spectrum of the force kernel, in the transposed layout the forward transform leaves, scaled by the inverse
+	// transform's 1 / PaddedSize^2
+	TArray<FVector2f> KernelSpectrum;
+
+	// PaddedSize^2 rows major working grids, Grid holds the masses then the field
+	TArray<FVector2f> Grid;
+	TArray<FVector2f> TransposeScratch;
+
+	// One mass lattice per assignment task, summed into Grid
+	TArray<TArray<float>> TaskMasses;
+
+	// exp(-2 Pi i k / PaddedSize) for k < PaddedSize / 2, & the bit reversal permutation
+	TArray<FVector2f> Twiddles;
+	TArray<uint32> BitReversal;
+
+public:
+	/**
+	 * @brief Sets the number of lattice nodes along each axis, rounded up to a power of two, applied on the next solve.
+	 */
+	FORCEINLINE void SetGridSize(const int InGridSize)
+	{
+		GridSize = FMath::RoundUpToPowerOfTwo(FMath::Clamp(InGridSize, MinGridSize, MaxGridSize));
+	}
+
+	/**
+	 * @brief Sets the radius the force is split at between grid & tree, in cells, applied on the next solve.
+	 */
+	FORCEINLINE void SetSplitScale(const float InSplitScale) { SplitScale = FMath::Max(InSplitScale, 0.5f); }
+
+	FORCEINLINE int GetGridSize() const { return GridSize; }
+
+	FMemoryFootprint GetMemoryFootprint() const
+	{
+		FMemoryFootprint Footprint;
+		Footprint.Add(KernelSpectrum);
+		Footprint.Add(Grid);
+		Footprint.Add(TransposeScratch);
+		for (const TArray<float>& Masses : TaskMasses)
+			Footprint.Add(Masses);
+		Footprint.Add(Twiddles);
+		Footprint.Add(BitReversal);
+		return Footprint;
+	}
+
+	/**
+	 * @brief Adds the velocity change every body applies to every other body, and sets every body's cost to its
+	 * number of short range interactions, 1 without a short range tree.
+	 * @param Bodies Bodies to update, must be within Bounds
+	 * @param Bounds Bounds the lattice spans
+	 * @param NumTasks Number of tasks the mass assignment is split across, each with its own lattice
+	 * @param ShortRangeTree Tree built for the bodies, the short range force is summed over it when not null
+	 * @param AccuracyCoefficient Opening angle of the short range walk
+	 * @return The total number of short range interactions
+	 */
+	int64 Solve(FBodyArray& Bodies, const FQuadrantBounds& Bounds, const int NumTasks,
+	            const TTreeView<ETreeBranchSize::QuadTree>* ShortRangeTree, const float AccuracyCoefficient)
+	{
+		const int NumBodies = Bodies.Num();
+		if (NumBodies < 2)
+			return 0;
+
+		Origin = FVector2f(Bounds.Left, Bounds.Top);
+		CellSize = FVector2f(Bounds.HorizontalSize(), Bounds.VerticalSize()) / (GridSize - 1);
+		const float SplitRadius = ShortRangeTree ? SplitScale * FMath::Max(CellSize.X, CellSize.Y) : 0;
+
+		if (KernelGridSize != GridSize || KernelCellSize != CellSize || KernelSplitRadius != SplitRadius)
+			BuildKernel(SplitRadius);
+
+		AssignMasses(Bodies, NumTasks);
+		ConvolveWithKernel();
+		InterpolateField(Bodies);
+
+		if (!ShortRangeTree)
+		{
+			::ParallelFor(NumBodies, [&Bodies](const int i) { Bodies.Cost[i] = 1; });
+			return NumBodies;
+		}
+		return AddShortRangeForces(Bodies, *ShortRangeTree, AccuracyCoefficient, SplitRadius);
+	}
+
+private:
+	static FORCEINLINE FVector2f ComplexMultiply(const FVector2f A, const FVector2f B)
+	{
+		return FVector2f(A.X * B.X - A.Y * B.Y, A.X * B.Y + A.Y * B.X);
+	}
+
+	/**
+	 * @brief Cloud in cell weights of a location, the lattice node below & left of it and the fraction towards the
+	 * next node along each axis.
+	 */
+	FORCEINLINE void GetCloudInCell(const float X, const float Y, int& OutNodeX, int& OutNodeY,
+	                                FVector2f& OutFraction) const
+	{
+		const float GridX = FMath::Clamp((X - Origin.X) / CellSize.X, 0.f, GridSize - 1.f);
+		const float GridY = FMath::Clamp((Y - Origin.Y) / CellSize.Y, 0.f, GridSize - 1.f);
+		OutNodeX = FMath::Min(FMath::FloorToInt32(GridX), GridSize - 2);
+		OutNodeY = FMath::Min(FMath::FloorToInt32(GridY), GridSize - 2);
+		OutFraction = FVector2f(GridX - OutNodeX, GridY - OutNodeY);
+	}
+
+	/**
+	 * @brief Samples the force law between every pair of lattice offsets, minus its short range part when split, &
+	 * transforms it once for every following solve.
+	 */
+	void BuildKernel(const float SplitRadius)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FParticleMeshSolver::BuildKernel);
+
+		PaddedSize = 2 * GridSize;
+		BuildTransformTables();
+
+		Grid.SetNumUninitialized(PaddedSize * PaddedSize);
+		TransposeScratch.SetNumUninitialized(PaddedSize * PaddedSize);
+
+		// Velocity change at offset D from a unit mass, -D / |D|^2, the field of a Gaussian of radius SplitRadius
+		// instead when split, which is the same times 1 - exp(-|D|^2 / 2 SplitRadius^2)
+		const float InvTwoSquaredSplit = SplitRadius > 0 ? 1.f / (2 * SplitRadius * SplitRadius) : 0;
+		::ParallelFor(PaddedSize, [this, InvTwoSquaredSplit](const int Row)
+		{
+			// Offsets past GridSize wrap around to negative ones, the one at GridSize is never reached by any pair
+			const int OffsetY = Row < GridSize ? Row : Row - PaddedSize;
+			for (int Col = 0; Col < PaddedSize; Col++)
+			{
+				const int OffsetX = Col < GridSize ? Col : Col - PaddedSize;
+				const FVector2f Dist(OffsetX * CellSize.X, OffsetY * CellSize.Y);
+				const float SquaredLength = Dist.SquaredLength();
+
+				FVector2f& Value = Grid[Row * PaddedSize + Col];
+				if (SquaredLength == 0 || Row == GridSize || Col == GridSize)
+				{
+					Value = FVector2f::ZeroVector;
+					continue;
+				}
+
+				float LongRange = 1;
+				if (InvTwoSquaredSplit > 0)
+					LongRange -= FMath::Exp(-SquaredLength * InvTwoSquaredSplit);
+				Value = -Dist * (LongRange / SquaredLength);
+			}
+		});
+
+		Transform(Grid, PaddedSize, false);
+
+		const float InverseScale = 1.f / (StaticCast<float>(PaddedSize) * PaddedSize);
+		KernelSpectrum.SetNumUninitialized(PaddedSize * PaddedSize);
+		::ParallelFor(PaddedSize, [this, InverseScale](const int Row)
+		{
+			for (int Col = 0; Col < PaddedSize; Col++)
+				KernelSpectrum[Row * PaddedSize + Col] = Grid[Row * PaddedSize + Col] * InverseScale;
+		});
+
+		KernelGridSize = GridSize;
+		KernelCellSize = CellSize;
+		KernelSplitRadius = SplitRadius;
+	}
+
+	void BuildTransformTables()
+	{
+		const int NumBits = FMath::FloorLog2(PaddedSize);
+
+		Twiddles.SetNumUninitialized(PaddedSize / 2);
+		for (int k = 0; k < PaddedSize / 2; k++)
+		{
+			const double Angle = -2 * UE_DOUBLE_PI * k / PaddedSize;
+			Twiddles[k] = FVector2f(StaticCast<float>(FMath::Cos(Angle)), StaticCast<float>(FMath::Sin(Angle)));
+		}
+
+		BitReversal.SetNumUninitialized(PaddedSize);
+		for (int i = 0; i < PaddedSize; i++)
+			BitReversal[i] = ReverseBits(StaticCast<uint32>(i)) >> (32 - NumBits);
+	}
+
+	/**
+	 * @brief Spreads the bodies' masses on the lattice, every task into its own copy, then sums them into the padded
+	 * grid.
+	 */
+	void AssignMasses(const FBodyArray& Bodies, const int NumTasks)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FParticleMeshSolver::AssignMasses);
+
+		const int NumBodies = Bodies.Num();
+		const int NumNodes = GridSize * GridSize;
+
+		// Small scenes aren't worth the extra lattices
+		constexpr int MinBodiesPerTask = 4096;
+		const int NumAssignTasks = FMath::Clamp(NumBodies / MinBodiesPerTask, 1, FMath::Max(NumTasks, 1));
+		const int BodiesPerTask = FMath::DivideAndRoundUp(NumBodies, NumAssignTasks);
+
+		TaskMasses.SetNum(NumAssignTasks);
+		::ParallelFor(NumAssignTasks, [&](const int Task)
+		{
+			TArray<float>& Masses = TaskMasses[Task];
+			Masses.SetNumUninitialized(NumNodes);
+			FMemory::Memzero(Masses.GetData(), NumNodes * sizeof(float));
+
+			const int End = FMath::Min(NumBodies, (Task + 1) * BodiesPerTask);
+			for (int i = Task * BodiesPerTask; i < End; i++)
+			{
+				int NodeX, NodeY;
+				FVector2f Fraction;
+				GetCloudInCell(Bodies.X[i], Bodies.Y[i], NodeX, NodeY, Fraction);
+
+				const float Mass = Bodies.Mass[i];
+				float* Node = &Masses[NodeY * GridSize + NodeX];
+				Node[0] += Mass * (1 - Fraction.X) * (1 - Fraction.Y);
+				Node[1] += Mass * Fraction.X * (1 - Fraction.Y);
+				Node[GridSize] += Mass * (1 - Fraction.X) * Fraction.Y;
+				Node[GridSize + 1] += Mass * Fraction.X * Fraction.Y;
+			}
+		});
+
+		// The padding rows' row transforms are skipped, but the column transforms read them, & they still hold whatever
+		// the kernel build or the last solve's transposes left there, so they're cleared every solve
+		::ParallelFor(PaddedSize, [&](const int Row)
+		{
+			FVector2f* GridRow = &Grid[Row * PaddedSize];
+			if (Row >= GridSize)
+			{
+				FMemory::Memzero(GridRow, PaddedSize * sizeof(FVector2f));
+				return;
+			}
+
+			for (int Col = 0; Col < GridSize; Col++)
+			{
+				float Mass = 0;
+				for (const TArray<float>& Masses : TaskMasses)
+					Mass += Masses[Row * GridSize + Col];
+				GridRow[Col] = FVector2f(Mass, 0);
+			}
+			for (int Col = GridSize; Col < PaddedSize; Col++)
+				GridRow[Col] = FVector2f::ZeroVector;
+		});
+	}
+
+	/**
+	 * @brief Replaces the masses in Grid with the field they create, ax + i ay on every node of the lattice.
+	 * Masses are real & the kernel's real & imaginary parts are the X & Y field kernels, so both field components come
+	 * out of a single inverse transform.
+	 */
+	void ConvolveWithKernel()
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FParticleMeshSolver::Convolve);
+
+		// Only the first GridSize rows hold any mass
+		Transform(Grid, GridSize, false);
+
+		::ParallelFor(PaddedSize, [this](const int Row)
+		{
+			for (int Col = 0; Col < PaddedSize; Col++)
+			{
+				const int Index = Row * PaddedSize + Col;
+				Grid[Index] = ComplexMultiply(Grid[Index], KernelSpectrum[Index]);
+			}
+		});
+
+		Transform(Grid, PaddedSize, true);
+	}
+
+	void InterpolateField(FBodyArray& Bodies)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FParticleMeshSolver::Interpolate);
+
+		::ParallelFor(Bodies.Num(), [&](const int i)
+		{
+			int NodeX, NodeY;
+			FVector2f Fraction;
+			GetCloudInCell(Bodies.X[i], Bodies.Y[i], NodeX, NodeY, Fraction);
+
+			const FVector2f* Node = &Grid[NodeY * PaddedSize + NodeX];
+			const FVector2f Field = Node[0] * ((1 - Fraction.X) * (1 - Fraction.Y)) +
+				Node[1] * (Fraction.X * (1 - Fraction.Y)) +
+				Node[PaddedSize] * ((1 - Fraction.X) * Fraction.Y) +
+				Node[PaddedSize + 1] * (Fraction.X * Fraction.Y);
+
+			Bodies.VX[i] += Field.X;
+			Bodies.VY[i] += Field.Y;
+		});
+	}
+
+	/**
+	 * @brief Adds the part of the force law the grid leaves out, D / |D|^2 * exp(-|D|^2 / 2 SplitRadius^2), from
+	 * every body & pseudo body within the cutoff.
+	 */
+	int64 AddShortRangeForces(FBodyArray& Bodies, const TTreeView<ETreeBranchSize::QuadTree>& Tree,
+	                          const float AccuracyCoefficient, const float SplitRadius)
+	{
+		TRACE_CPUPROFILER_EVENT_SCOPE(FParticleMeshSolver::ShortRange);
+
+		const float Cutoff = ShortRangeCutoff * SplitRadius;
+		const float SquaredCutoff = Cutoff * Cutoff;
+		const float InvTwoSquaredSplit = 1.f / (2 * SplitRadius * SplitRadius);
+		std::atomic<int64> NumInteractions{0};
+
+		// Same spatial chunks as the tree's force pass would use, so neighbouring bodies share cache lines
+		constexpr int ChunkSize = 256;
+		::ParallelFor(FMath::DivideAndRoundUp(Bodies.Num(), ChunkSize), [&](const int Chunk)
+		{
+			int64 NumChunkInteractions = 0;
+			const int End = FMath::Min(Bodies.Num(), (Chunk + 1) * ChunkSize);
+			for (int i = Chunk * ChunkSize; i < End; i++)
+			{
+				const FVector2f Location = Bodies.GetLocation(i);
+				FVector2f Velocity(0);
+				int NumNear = 0;
+
+				TTreeWalker<ETreeBranchSize::QuadTree>::WalkWithinRadius(Tree, Location, i, AccuracyCoefficient,
+					Cutoff, [&](const FVector2f OtherLocation, const float OtherMass)
+					{
+						const FVector2f Dist = OtherLocation - Location;
+						const float SquaredLength = Dist.SquaredLength();
+						if (SquaredLength >= SquaredCutoff)
+							return;
+
+						Velocity += Dist * (OtherMass * FMath::Exp(-SquaredLength * InvTwoSquaredSplit) /
+							SquaredLength);
+						++NumNear;
+					});
+
+				Bodies.VX[i] += Velocity.X;
+				Bodies.VY[i] += Velocity.Y;
+				Bodies.Cost[i] = FMath::Max(NumNear, 1);
+				NumChunkInteractions += NumNear;
+			}
+			NumInteractions.fetch_add(NumChunkInteractions, std::memory_order_relaxed);
+		});
+
+		return NumInteractions.load();
+	}
+
+	/**
+	 * @brief 2D FFT of a PaddedSize^2 grid, as row transforms, a transpose & row transforms again, so every
+	 * transform runs over contiguous memory. The result is left transposed, which is fine as long as the kernel's
+	 * spectrum is laid out the same way, and the inverse transform of a transposed spectrum transposes it back.
+	 * @param Data Grid to transform in place
+	 * @param NumInputRows Rows of Data that aren't all zeros, the rest are assumed zero and skip their first pass
+	 * @param bInverse Whether to run the unnormalized inverse transform, only the first GridSize rows of the result
+	 * are computed
+	 */
+	void Transform(TArray<FVector2f>& Data, const int NumInputRows, const bool bInverse)
+	{
+		::ParallelFor(NumInputRows, [&](const int Row)
+		{
+			TransformRow(&Data[Row * PaddedSize], bInverse);
+		});
+
+		Transpose(Data, TransposeScratch);
+		Swap(Data, TransposeScratch);
+
+		::ParallelFor(bInverse ? GridSize : PaddedSize, [&](const int Row)
+		{
+			TransformRow(&Data[Row * PaddedSize], bInverse);
+		});
+	}
+
+	/**
+	 * @brief In place iterative radix 2 FFT of one row.
+	 */
+	void TransformRow(FVector2f* RESTRICT Row, const bool bInverse) const
+	{
+		for (int i = 0; i < PaddedSize; i++)
+		{
+			const int j = BitReversal[i];
+			if (i < j)
+				Swap(Row[i], Row[j]);
+		}
+
+		for (int Length = 2; Length <= PaddedSize; Length <<= 1)
+		{
+			const int HalfLength = Length / 2;
+			const int TwiddleStride = PaddedSize / Length;
+			for (int Start = 0; Start < PaddedSize; Start += Length)
+			{
+				for (int k = 0; k < HalfLength; k++)
+				{
+					FVector2f Twiddle = Twiddles[k * TwiddleStride];
+					if (bInverse)
+						Twiddle.Y = -Twiddle.Y;
+
+					const FVector2f Even = Row[Start + k];
+					const FVector2f Odd = ComplexMultiply(Row[Start + k + HalfLength], Twiddle);
+					Row[Start + k] = Even + Odd;
+					Row[Start + k + HalfLength] = Even - Odd;
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Out of place transpose in tiles small enough for both sides to stay in L1.
+	 */
+	void Transpose(const TArray<FVector2f>& Source, TArray<FVector2f>& Destination) const
+	{
+		constexpr int TileSize = 32;
+		const int NumTiles = PaddedSize / TileSize;
+
+		::ParallelFor(NumTiles * NumTiles, [&](const int Tile)
+		{
+			const int TileRow = (Tile / NumTiles) * TileSize;
+			const int TileCol = (Tile % NumTiles) * TileSize;
+			for (int Row = TileRow; Row < TileRow + TileSize; Row++)
+			{
+				for (int Col = TileCol; Col < TileCol + TileSize; Col++)
+					Destination[Col * PaddedSize + Row] = Source[Row * PaddedSize + Col];
+			}
+		});
+	}
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+/**
+ * @brief Counter based random stream, Philox4x32-10.
+ * Every block of four numbers is a pure function of the seed & a 128 bit counter, so any number of streams can be
+ * drawn from in any order, on any thread, & always give the same numbers. A stream is picked by the upper 96 bits of
+ * the counter, the lower 32 count the blocks drawn from it.
+ * Same drawing interface as FRandomStream, so either can feed the same sampling code.
+ */
+class FPhiloxRandom
+{
+	static constexpr uint32 Multiplier0 = 0xD2511F53;
+	static constexpr uint32 Multiplier1 = 0xCD9E8D57;
+	// Key schedule increments, golden ratio & sqrt(3) - 1
+	static constexpr uint32 KeyIncrement0 = 0x9E3779B9;
+	static constexpr uint32 KeyIncrement1 = 0xBB67AE85;
+	static constexpr int NumRounds = 10;
+
+	uint32 Key[2];
+	uint32 Counter[4];
+
+	// Last block drawn & how much of it was used
+	uint32 Block[4];
+	int NextWord = 4;
+
+public:
+	/**
+	 * @param Seed Key every stream of a run shares
+	 * @param Stream Which stream of the seed to draw from, a body index for instance
+	 * @param SubStream Further splits a stream, so unrelated draws for the same body never overlap
+	 */
+	FPhiloxRandom(const uint64 Seed, const uint64 Stream, const uint32 SubStream = 0)
+		: Key{StaticCast<uint32>(Seed), StaticCast<uint32>(Seed >> 32)},
+		  Counter{0, SubStream, StaticCast<uint32>(Stream), StaticCast<uint32>(Stream >> 32)}
+	{
+	}
+
+	/**
+	 * @return Uniformly distributed 32 bit number
+	 */
+	FORCEINLINE uint32 GetUnsignedInt()
+	{
+		if (NextWord == 4)
+		{
+			GenerateBlock();
+			NextWord = 0;
+		}
+		return Block[NextWord++];
+	}
+
+	/**
+	 * @return Uniformly distributed number in [0, 1)
+	 */
+	FORCEINLINE float GetFraction()
+	{
+		// 24 bits, every float in the range is then exactly reachable & 1 never is
+		return (GetUnsignedInt() >> 8) * (1.f / 16777216.f);
+	}
+
+	/**
+	 * @return Uniformly distributed number in [Min, Max)
+	 */
+	FORCEINLINE float FRandRange(const float Min, const float Max)
+	{
+		return Min + (Max - Min) * GetFraction();
+	}
+
+	/**
+	 * @return Uniformly distributed integer in [0, Max), 0 if Max isn't positive
+	 */
+	FORCEINLINE int RandHelper(const int Max)
+	{
+		return Max > 0 ? StaticCast<int>((StaticCast<uint64>(GetUnsignedInt()) * Max) >> 32) : 0;
+	}
+
+private:
+	FORCEINLINE void GenerateBlock()
+	{
+		uint32 X[4] = {Counter[0], Counter[1], Counter[2], Counter[3]};
+		uint32 K[2] = {Key[0], Key[1]};
+
+		for (int Round = 0; Round < NumRounds; Round++)
+		{
+			const uint64 Product0 = StaticCast<uint64>(Multiplier0) * X[0];
+			const uint64 Product1 = StaticCast<uint64>(Multiplier1) * X[2];
+
+			const uint32 Next0 = StaticCast<uint32>(Product1 >> 32) ^ X[1] ^ K[0];
+			const uint32 Next2 = StaticCast<uint32>(Product0 >> 32) ^ X[3] ^ K[1];
+			X[0] = Next0;
+			X[1] = StaticCast<uint32>(Product1);
+			X[2] = Next2;
+			X[3] = StaticCast<uint32>(Product0);
+
+			K[0] += KeyIncrement0;
+			K[1] += KeyIncrement1;
+		}
+
+		Block[0] = X[0];
+		Block[1] = X[1];
+		Block[2] = X[2];
+		Block[3] = X[3];
+		++Counter[0];
+	}
+};
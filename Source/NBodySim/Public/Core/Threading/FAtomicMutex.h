@@ -14,19 +14,25 @@ private:
 	static constexpr bool LockedState = true;
 	static constexpr bool UnlockedState = false;
 
-	std::atomic<bool> LockObject;
-	
+	std::atomic<bool> LockObject{UnlockedState};
+
 public:
 
 	/**
-	 * @brief Spins thread while waiting for to acquire a lock. 
+	 * @brief Spins thread while waiting for to acquire a lock.
 	 */
 	FORCEINLINE void SpinWaitLock()
 	{
 		bool CurrentState = UnlockedState;
 
-		while(!LockObject.compare_exchange_weak(CurrentState, true, std::memory_order_relaxed))
+		// Acquire, so everything the previous owner wrote before unlocking is visible once we hold the lock
+		while(!LockObject.compare_exchange_weak(CurrentState, LockedState, std::memory_order_acquire,
+		                                        std::memory_order_relaxed))
 		{
+			// Only read while it's held, so waiters don't keep stealing the cache line from the owner
+			while (LockObject.load(std::memory_order_relaxed) == LockedState)
+				FPlatformProcess::Yield();
+
 			// Reset current state
 			CurrentState = UnlockedState;
 		}
@@ -38,7 +44,9 @@ public:
 	FORCEINLINE void Unlock()
 	{
 		// Less safe then using a CAS loop, should be used with a scope lock.
-		check(LockObject == LockedState);
-		LockObject.store(UnlockedState, std::memory_order_relaxed);
+		check(LockObject.load(std::memory_order_relaxed) == LockedState);
+
+		// Release, so everything written while holding the lock is visible to the next owner
+		LockObject.store(UnlockedState, std::memory_order_release);
 	}
 };
@@ -0,0 +1,272 @@
+#pragma once
+#include "Async/ParallelFor.h"
+#include "Algo/BinarySearch.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Tasks/Task.h"
+
+/**
+ * @brief Time spent by one worker during the last FWorkStealingScheduler pass.
+ */
+struct FWorkerStats
+{
+	// Time spent running chunks
+	double BusySeconds = 0;
+
+	// Time spent waiting to start, looking for chunks to steal, or done while other workers were still busy
+	double IdleSeconds = 0;
+
+	int NumChunks = 0;
+	int NumStolen = 0;
+};
+
+/**
+ * @brief Splits a range into many small chunks and runs them on the task system's workers with work stealing.
+ * Every worker starts with a contiguous range of chunks, pops from the front of its own range and once it runs dry
+ * steals from the back of the other workers' ranges. The calling thread is worker 0, so it works instead of waiting,
+ * & runs any worker that hasn't started by the time it's done itself, so passes can be started from within a task.
+ * Ranges never grow once a pass starts, so every queue is a single packed atomic and no locks are needed.
+ */
+class FWorkStealingScheduler
+{
+private:
+	// Remaining chunks of a worker, packed as Head << 32 | Tail. Padded so workers don't share a cache line.
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FWorkerQueue
+	{
+		std::atomic<uint64> Range{0};
+	};
+
+	TUniquePtr<FWorkerQueue[]> Queues;
+	TArray<FWorkerStats> WorkerStats;
+	const int NumWorkers;
+
+	double LastPassSeconds = 0;
+
+public:
+	/**
+	 * @param NumWorkers Number of workers, including the calling thread
+	 */
+	explicit FWorkStealingScheduler(const int NumWorkers) :
+		NumWorkers(FMath::Max(NumWorkers, 1))
+	{
+		Queues = MakeUnique<FWorkerQueue[]>(this->NumWorkers);
+		WorkerStats.SetNum(this->NumWorkers);
+	}
+
+	FORCEINLINE int GetNumWorkers() const { return NumWorkers; }
+
+	/**
+	 * @brief Per worker stats of the last pass, indexed by worker.
+	 */
+	FORCEINLINE TArrayView<const FWorkerStats> GetWorkerStats() const { return WorkerStats; }
+
+	/**
+	 * @brief Wall time of the last pass, from the first chunk being handed out to the last worker finishing.
+	 */
+	FORCEINLINE double GetLastPassSeconds() const { return LastPassSeconds; }
+
+	/**
+	 * @brief Runs Task over [0, NumItems) in chunks of ChunkSize items and returns once every chunk is done.
+	 * @param NumItems Number of items to process
+	 * @param ChunkSize Number of items handed out at once, small enough that stealing can even the load out
+	 * @param Task Called as Task(int Start, int End, int WorkerIndex), concurrently for different chunks. WorkerIndex
+	 * is in [0, GetNumWorkers()) and unique among running calls, so it can index per worker scratch data.
+	 */
+	template<typename TaskType>
+	FORCEINLINE void ParallelFor(const int NumItems, const int ChunkSize, TaskType&& Task)
+	{
+		RunPass(NumItems, ChunkSize, TArrayView<const double>(), Task);
+	}
+
+	/**
+	 * @brief Same as ParallelFor, but workers start with equal cost slices of the range rather than equal item counts.
+	 * Stealing still evens out whatever the costs got wrong.
+	 * @param ChunkCostPrefix Cost of all chunks before every chunk, plus the total cost. See BuildChunkCostPrefix.
+	 */
+	template<typename TaskType>
+	FORCEINLINE void ParallelForWeighted(const int NumItems, const int ChunkSize,
+	                                     const TArrayView<const double> ChunkCostPrefix, TaskType&& Task)
+	{
+		check(ChunkCostPrefix.Num() == FMath::DivideAndRoundUp(NumItems, ChunkSize) + 1);
+		RunPass(NumItems, ChunkSize, ChunkCostPrefix, Task);
+	}
+
+	/**
+	 * @brief Exclusive prefix sum of chunk costs, as expected by ParallelForWeighted.
+	 * @param ItemCost Called as ItemCost(int Index) for every item, concurrently
+	 */
+	template<typename CostType>
+	static void BuildChunkCostPrefix(const int NumItems, const int ChunkSize, CostType&& ItemCost,
+	                                 TArray<double>& OutChunkCostPrefix);
+
+private:
+	static FORCEINLINE uint64 PackRange(const uint32 Head, const uint32 Tail)
+	{
+		return StaticCast<uint64>(Head) << 32 | Tail;
+	}
+
+	/**
+	 * @brief Takes the next chunk from the front of the worker's own range.
+	 */
+	bool PopChunk(const int WorkerIndex, uint32& OutChunk)
+	{
+		std::atomic<uint64>& Range = Queues[WorkerIndex].Range;
+		uint64 Current = Range.load(std::memory_order_acquire);
+		while (true)
+		{
+			const uint32 Head = Current >> 32;
+			const uint32 Tail = StaticCast<uint32>(Current);
+			if (Head >= Tail)
+				return false;
+
+			if (Range.compare_exchange_weak(Current, PackRange(Head + 1, Tail), std::memory_order_acq_rel))
+			{
+				OutChunk = Head;
+				return true;
+			}
+		}
+	}
+
+	/**
+	 * @brief Takes a chunk from the back of another worker's range, starting with the next worker along.
+	 */
+	bool StealChunk(const int WorkerIndex, uint32& OutChunk)
+	{
+		for (int Offset = 1; Offset < NumWorkers; Offset++)
+		{
+			std::atomic<uint64>& Range = Queues[(WorkerIndex + Offset) % NumWorkers].Range;
+			uint64 Current = Range.load(std::memory_order_acquire);
+			while (true)
+			{
+				const uint32 Head = Current >> 32;
+				const uint32 Tail = StaticCast<uint32>(Current);
+				if (Head >= Tail)
+					break;
+
+				if (Range.compare_exchange_weak(Current, PackRange(Head, Tail - 1), std::memory_order_acq_rel))
+				{
+					OutChunk = Tail - 1;
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	template<typename TaskType>
+	void RunPass(const int NumItems, const int ChunkSize, const TArrayView<const double> ChunkCostPrefix,
+	             TaskType& Task);
+
+	template<typename TaskType>
+	void RunWorker(const int WorkerIndex, const int NumItems, const int ChunkSize, TaskType& Task)
+	{
+		// One scope per worker & pass, so Insights shows each worker's share of the pass on its own thread
+		TRACE_CPUPROFILER_EVENT_SCOPE(FWorkStealingScheduler::RunWorker);
+		FWorkerStats& Stats = WorkerStats[WorkerIndex];
+
+		uint32 Chunk;
+		while (true)
+		{
+			const bool bIsOwnChunk = PopChunk(WorkerIndex, Chunk);
+			if (!bIsOwnChunk && !StealChunk(WorkerIndex, Chunk))
+				break;
+
+			const int Start = Chunk * ChunkSize;
+			const double ChunkStartTime = FPlatformTime::Seconds();
+			Task(Start, FMath::Min(NumItems, Start + ChunkSize), WorkerIndex);
+			Stats.BusySeconds += FPlatformTime::Seconds() - ChunkStartTime;
+
+			++Stats.NumChunks;
+			Stats.NumStolen += !bIsOwnChunk;
+		}
+	}
+};
+
+template<typename CostType>
+void FWorkStealingScheduler::BuildChunkCostPrefix(const int NumItems, const int ChunkSize, CostType&& ItemCost,
+                                                  TArray<double>& OutChunkCostPrefix)
+{
+	const int NumChunks = FMath::DivideAndRoundUp(NumItems, ChunkSize);
+	OutChunkCostPrefix.SetNumUninitialized(NumChunks + 1);
+	OutChunkCostPrefix[0] = 0;
+
+	// Every chunk sums itself in parallel into the slot after it, then one short serial scan over the chunks
+	::ParallelFor(NumChunks, [&](const int Chunk)
+	{
+		double ChunkCost = 0;
+		const int ChunkEnd = FMath::Min(NumItems, (Chunk + 1) * ChunkSize);
+		for (int i = Chunk * ChunkSize; i < ChunkEnd; i++)
+			ChunkCost += ItemCost(i);
+
+		OutChunkCostPrefix[Chunk + 1] = ChunkCost;
+	});
+
+	for (int Chunk = 0; Chunk < NumChunks; Chunk++)
+		OutChunkCostPrefix[Chunk + 1] += OutChunkCostPrefix[Chunk];
+}
+
+template<typename TaskType>
+void FWorkStealingScheduler::RunPass(const int NumItems, const int ChunkSize,
+                                     const TArrayView<const double> ChunkCostPrefix, TaskType& Task)
+{
+	for (FWorkerStats& Stats : WorkerStats)
+		Stats = FWorkerStats();
+
+	LastPassSeconds = 0;
+	if (NumItems <= 0)
+		return;
+
+	check(ChunkSize > 0);
+	const int NumChunks = FMath::DivideAndRoundUp(NumItems, ChunkSize);
+	const int NumActiveWorkers = FMath::Min(NumWorkers, NumChunks);
+
+	// Contiguous starting ranges, so a worker that never steals walks its items in order
+	const bool bIsWeighted = ChunkCostPrefix.Num() > 0 && ChunkCostPrefix.Last() > 0;
+	uint32 Head = 0;
+	for (int WorkerIndex = 0; WorkerIndex < NumWorkers; WorkerIndex++)
+	{
+		uint32 Tail = NumChunks;
+		if (WorkerIndex >= NumActiveWorkers)
+		{
+			Tail = Head;
+		}
+		else if (WorkerIndex < NumActiveWorkers - 1)
+		{
+			if (bIsWeighted)
+			{
+				// First chunk starting at or past this worker's share of the total cost
+				const double SliceEnd = ChunkCostPrefix.Last() * (WorkerIndex + 1) / NumActiveWorkers;
+				Tail = Algo::LowerBound(ChunkCostPrefix, SliceEnd);
+				Tail = FMath::Clamp<uint32>(Tail, Head, NumChunks);
+			}
+			else
+			{
+				Tail = StaticCast<int64>(NumChunks) * (WorkerIndex + 1) / NumActiveWorkers;
+			}
+		}
+
+		Queues[WorkerIndex].Range.store(PackRange(Head, Tail), std::memory_order_relaxed);
+		Head = Tail;
+	}
+
+	const double PassStartTime = FPlatformTime::Seconds();
+
+	TArray<UE::Tasks::FTask, TInlineAllocator<16>> WorkerTasks;
+	for (int WorkerIndex = 1; WorkerIndex < NumActiveWorkers; WorkerIndex++)
+	{
+		WorkerTasks.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, WorkerIndex, NumItems, ChunkSize, &Task]()
+		{
+			RunWorker(WorkerIndex, NumItems, ChunkSize, Task);
+		}));
+	}
+
+	RunWorker(0, NumItems, ChunkSize, Task);
+
+	// Waiting on a task that hasn't started yet retracts it & runs it here, so a pass never stalls on busy workers
+	for (UE::Tasks::FTask& WorkerTask : WorkerTasks)
+		WorkerTask.Wait();
+
+	LastPassSeconds = FPlatformTime::Seconds() - PassStartTime;
+	for (FWorkerStats& Stats : WorkerStats)
+		Stats.IdleSeconds = LastPassSeconds - Stats.BusySeconds;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+ * @brief Lock free single producer, single consumer triple buffer.
+ * The writer fills its buffer & publishes it by swapping it with the middle buffer, the reader takes the middle buffer
+ * by swapping it with its own. Neither side ever waits on the other, the reader always gets the latest published
+ * buffer and any buffer it skipped is simply overwritten.
+ */
+template<typename T>
+class TTripleBuffer
+{
+private:
+	static constexpr uint8 IndexMask = 0b011;
+	// Set on the middle index while it holds a buffer the reader hasn't taken yet
+	static constexpr uint8 DirtyBit = 0b100;
+
+	T Buffers[3];
+
+	// Only touched by their own side
+	uint8 WriteIndex = 0;
+	uint8 ReadIndex = 1;
+
+	std::atomic<uint8> MiddleState{2};
+
+public:
+	/**
+	 * @brief Writer side, the buffer to fill before calling Publish.
+	 * Holds whatever was in it the last time it was published or read, not necessarily the last published buffer.
+	 */
+	FORCEINLINE T& GetWriteBuffer() { return Buffers[WriteIndex]; }
+
+	/**
+	 * @brief Writer side, hands the write buffer over to the reader & takes a free buffer to write the next one into.
+	 */
+	FORCEINLINE void Publish()
+	{
+		const uint8 Previous = MiddleState.exchange(WriteIndex | DirtyBit, std::memory_order_acq_rel);
+		WriteIndex = Previous & IndexMask;
+	}
+
+	/**
+	 * @brief Reader side, takes the latest published buffer if there's one it hasn't taken yet.
+	 * @return True if the read buffer changed
+	 */
+	FORCEINLINE bool Update()
+	{
+		if ((MiddleState.load(std::memory_order_relaxed) & DirtyBit) == 0)
+			return false;
+
+		// Only the reader clears the dirty bit, so it's still set here
+		const uint8 Previous = MiddleState.exchange(ReadIndex, std::memory_order_acq_rel);
+		ReadIndex = Previous & IndexMask;
+		return true;
+	}
+
+	/**
+	 * @brief Reader side, the buffer taken by the last successful Update.
+	 */
+	FORCEINLINE const T& GetReadBuffer() const { return Buffers[ReadIndex]; }
+
+	/**
+	 * @brief Calls Func with every buffer, whichever side holds it.
+	 * Only safe from the writer side, & only as long as the reader never resizes or reallocates its buffers.
+	 */
+	template<typename FuncType>
+	FORCEINLINE void ForEachBuffer(FuncType&& Func) const
+	{
+		for (const T& Buffer : Buffers)
+			Func(Buffer);
+	}
+};
@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "NBodyAccuracyCommandlet.generated.h"
+
+/**
+ * @brief Measures the accuracy coefficient's accuracy vs speed trade-off against exact pairwise forces.
+ * Takes one snapshot of the bodies, computes every body's exact O(N^2) velocity change in double precision, then for
+ * every coefficient compares UNBodySimulationSubsystem::CalculateBodyVelocity against it, once with monopoles only and
+ * once with quadrupole moments. Reports relative error percentiles, interactions per body & time as CSV, one row per
+ * coefficient & expansion order, so the coefficient each order needs for a given error can be compared on time.
+ * The particle mesh solver is measured on the same snapshot, once on its own & once as TreePM at every coefficient.
+ *
+ * UnrealEditor-Cmd NBodySim.uproject -run=NBodyAccuracy -nullrhi -unattended
+ *     [-Bodies=10000] [-Coefficients=0.3,0.5,0.7,1.0,1.2,1.5]
+ *     [-Distribution=Uniform|Clustered|Plummer|ExponentialDisk|Merger] [-WarmupSteps=0] [-Seed=1234]
+ *     [-WorldSize=4096] [-GridSize=256] [-Output=<path.csv>]
+ */
+UCLASS()
+class NBODYSIM_API UNBodyAccuracyCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UNBodyAccuracyCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
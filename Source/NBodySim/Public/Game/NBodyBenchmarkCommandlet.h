@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "NBodyBenchmarkCommandlet.generated.h"
+
+/**
+ * @brief Headless end to end benchmark of UNBodySimulationSubsystem.
+ * Sweeps body count, accuracy coefficient & worker count with a fixed seed, steps the simulation in a world that's
+ * never rendered and writes per phase timings as CSV.
+ * Runs Barnes Hut unless told otherwise, the Solver column lists every solver the timed steps actually ran.
+ *
+ * UnrealEditor-Cmd NBodySim.uproject -run=NBodyBenchmark -nullrhi -unattended
+ *     [-Bodies=1000,10000,100000] [-Coefficients=0.5,1.2] [-Workers=1,2,4,8] [-Steps=100] [-WarmupSteps=10]
+ *     [-Seed=1234] [-WorldSize=4096] [-Distribution=Uniform|Clustered|Plummer|ExponentialDisk|Merger]
+ *     [-Solver=BarnesHut|Direct|FastMultipole|ParticleMesh|Auto] [-Output=<path.csv>]
+ */
+UCLASS()
+class NBODYSIM_API UNBodyBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UNBodyBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
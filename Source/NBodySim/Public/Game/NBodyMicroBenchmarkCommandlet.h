@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "NBodyMicroBenchmarkCommandlet.generated.h"
+
+/**
+ * @brief Isolated benchmarks of the tree & kernel building blocks, away from whole frame noise.
+ * Every benchmark runs on uniform, clustered & Plummer body sets of every requested size and reports throughput, plus
+ * cache misses per item where hardware counters are available (Linux perf events).
+ *
+ * UnrealEditor-Cmd NBodySim.uproject -run=NBodyMicroBenchmark -nullrhi -unattended
+ *     [-Sizes=1000,10000,100000] [-Distributions=Uniform,Clustered,Plummer] [-Iterations=5] [-Coefficient=1.2]
+ *     [-Seed=1234] [-Output=<path.csv>]
+ */
+UCLASS()
+class NBODYSIM_API UNBodyMicroBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UNBodyMicroBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -9,12 +9,135 @@
 #include "Subsystems/WorldSubsystem.h"
 #include "Camera/CameraActor.h"
 #include "Core/DataStructure/QuadrantBounds.h"
+#include "Core/DataStructure/BodyArray.h"
+#include "Core/DataStructure/BodyRenderFrame.h"
+#include "Core/DataStructure/InteractionList.h"
 #include "Core/DataStructure/BarnesHutTree.h"
+#include "Core/DataStructure/LinearQuadTree.h"
+#include "Core/DataStructure/QuadrupoleMoments.h"
+#include "Core/DataStructure/SpatialBodyOrder.h"
+#include "Core/DataStructure/TreeWalker.h"
+#include "Core/Math/BlockTimeStepper.h"
+#include "Core/Math/BodyDistribution.h"
+#include "Core/Math/DirectForceSolver.h"
+#include "Core/Math/FastMultipoleSolver.h"
+#include "Core/Math/ParticleMeshSolver.h"
+#include "Core/Threading/FWorkStealingScheduler.h"
+#include "Core/Threading/TTripleBuffer.h"
 
 #include "NBodySimulationSubsystem.generated.h"
 
 DECLARE_STATS_GROUP(TEXT("Threading"), STATGROUP_NBodySim, STATCAT_Advanced);
 DECLARE_DWORD_COUNTER_STAT(TEXT("Num Spawned Bodies"), NBodySim_NumSpawnedBodies, STATGROUP_NBodySim)
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Force Pass Worker Idle %"), NBodySim_WorkerIdlePercentage, STATGROUP_NBodySim)
+DECLARE_DWORD_COUNTER_STAT(TEXT("Num Tree Nodes"), NBodySim_NumTreeNodes, STATGROUP_NBodySim)
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Depth"), NBodySim_TreeDepth, STATGROUP_NBodySim)
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Interactions Per Body"), NBodySim_InteractionsPerBody, STATGROUP_NBodySim)
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Opened Cells Per Body"), NBodySim_OpenedCellsPerBody, STATGROUP_NBodySim)
+DECLARE_DWORD_COUNTER_STAT(TEXT("Direct Solver Crossover"), NBodySim_DirectCrossover, STATGROUP_NBodySim)
+DECLARE_DWORD_COUNTER_STAT(TEXT("Num Active Bodies"), NBodySim_NumActiveBodies, STATGROUP_NBodySim)
+
+// Simulation step phases, in the order they run
+DECLARE_CYCLE_STAT(TEXT("Reorder"), NBodySim_Reorder, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Warp"), NBodySim_Warp, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Tree Build"), NBodySim_TreeBuild, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Quadrupole Moments"), NBodySim_Quadrupoles, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Force Pass"), NBodySim_ForcePass, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Integrate"), NBodySim_Integrate, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Render Packing"), NBodySim_RenderPacking, STATGROUP_NBodySim);
+DECLARE_CYCLE_STAT(TEXT("Debug"), NBodySim_Debug, STATGROUP_NBodySim);
+
+// Allocated bytes, capacity included, & their high water marks
+DECLARE_MEMORY_STAT(TEXT("Bodies"), NBodySim_BodiesMemory, STATGROUP_NBodySim);
+DECLARE_MEMORY_STAT(TEXT("Tree"), NBodySim_TreeMemory, STATGROUP_NBodySim);
+DECLARE_MEMORY_STAT(TEXT("Render Buffers"), NBodySim_RenderBuffersMemory, STATGROUP_NBodySim);
+DECLARE_MEMORY_STAT(TEXT("Peak Bodies"), NBodySim_PeakBodiesMemory, STATGROUP_NBodySim);
+DECLARE_MEMORY_STAT(TEXT("Peak Tree"), NBodySim_PeakTreeMemory, STATGROUP_NBodySim);
+DECLARE_MEMORY_STAT(TEXT("Peak Render Buffers"), NBodySim_PeakRenderBuffersMemory, STATGROUP_NBodySim);
+
+/**
+ * @brief Force solver a simulation step runs, values match NBodySim.Force.Solver.
+ */
+UENUM(BlueprintType)
+enum class ENBodySolver : uint8
+{
+	// Direct or Barnes Hut, whichever the calibrated cost models predict to be faster for the body count
+	Auto,
+	BarnesHut,
+	Direct,
+	FastMultipole,
+	ParticleMesh
+};
+
+/**
+ * @brief Wall time spent in every phase of one simulation step.
+ */
+struct FSimulationStepTimings
+{
+	// Reordering, warping & tree build
+	double BuildSeconds = 0;
+	double ForceSeconds = 0;
+	double IntegrateSeconds = 0;
+	// Packing & publishing render data
+	double PackSeconds = 0;
+	double StepSeconds = 0;
+};
+
+/**
+ * @brief Online cost model of the direct & tree solvers on this host, fed by the step timings of whichever one ran.
+ */
+struct FSolverCalibration
+{
+	// Weight of every new sample in the running estimates
+	static constexpr double SmoothingFactor = 0.1;
+	// Steps between measurements of the solver that's predicted to be slower, while it's within ProbeMargin
+	static constexpr int ProbeInterval = 240;
+	static constexpr double ProbeMargin = 2;
+	// Never try the direct solver above this many bodies, a single step would be a visible hitch
+	static constexpr int MaxDirectBodies = 16384;
+
+	// Warp & direct force pass seconds per body pair, 0 until measured
+	double DirectSecondsPerPair = 0;
+	// Warp, tree build & force pass seconds per N log2 N, 0 until measured
+	double TreeSecondsPerBodyLog = 0;
+	int StepsSinceProbe = 0;
+
+	// Body count from which the tree is predicted to be faster, 0 until both solvers were measured
+	int Crossover = 0;
+
+	FORCEINLINE bool IsCalibrated() const { return DirectSecondsPerPair > 0 && TreeSecondsPerBodyLog > 0; }
+
+	FORCEINLINE double PredictDirectSeconds(const int NumBodies) const
+	{
+		return DirectSecondsPerPair * 0.5 * NumBodies * (NumBodies - 1);
+	}
+
+	FORCEINLINE double PredictTreeSeconds(const int NumBodies) const
+	{
+		return TreeSecondsPerBodyLog * NumBodies * FMath::Log2(StaticCast<double>(FMath::Max(NumBodies, 2)));
+	}
+};
+
+/**
+ * @brief Memory held by the simulation's containers.
+ */
+struct FSimulationMemoryUsage
+{
+	FMemoryFootprint Bodies;
+	// Both tree backends, including their build scratch, the fast multipole boxes & the particle mesh grids
+	FMemoryFootprint Tree;
+	// All three render buffers
+	FMemoryFootprint RenderBuffers;
+
+	FORCEINLINE FMemoryFootprint GetTotal() const
+	{
+		FMemoryFootprint Total = Bodies;
+		Total += Tree;
+		Total += RenderBuffers;
+		return Total;
+	}
+};
+
 /**
  * 
  */
@@ -32,13 +155,105 @@ protected:
 
 	FQuadrantBounds WorldBounds;
 
-	TArray<FBodyDescriptor> Bodies;
+	// WorldBounds as they were when the current step started, the only bounds a step reads. The game thread keeps
+	// changing WorldBounds on viewport resizes while a step runs off it, & bodies warped into one bounds must be
+	// inserted into a tree spanning the same ones
+	FQuadrantBounds StepBounds;
+
+	FBodyArray Bodies;
+
+	// Stable index of every body, what render data & Blueprints address bodies by while Bodies is kept in Morton order
+	FSpatialBodyOrder BodyOrder;
+
+	// Packed frames, written by the simulation step & read by the game thread, see AcquireRenderFrame
+	TTripleBuffer<FBodyRenderFrame> RenderBuffers;
+
+	// Game frame the read buffer was last taken on, so every reader of a frame sees the same buffer
+	uint64 RenderBuffersReadFrame = MAX_uint64;
+
+	// Whether the renderer reads RenderBuffers through UNiagaraDataInterfaceNBodyBodies, rather than being handed an
+	// array copy of every frame
+	bool bRendersThroughDataInterface = false;
+
+	// Array copy of the last frame, for renderers without the data interface
+	TArray<FVector> ArrayRenderData;
+
+	/**
+	 * @brief The simulation step running off the game thread, when NBodySim.Threading.bAsyncSimulation is set
+	 */
+	UE::Tasks::FTask SimulationTask;
+
+	/**
+	 * @brief Per phase wall time of the last simulation step
+	 */
+	FSimulationStepTimings LastStepTimings;
+
+	/**
+	 * @brief Memory held at the end of the last simulation step, & the most held at the end of any step so far
+	 */
+	FSimulationMemoryUsage MemoryUsage;
+	FSimulationMemoryUsage PeakMemoryUsage;
+
+	/**
+	 * @brief Number of workers the simulation splits its passes across, including the calling thread
+	 */
+	int NumWorkers = 1;
 
-	// Much better way to do this would be to expose FBodyDescriptor to a NiagaraDataInterface but no time
-	// Array containing (X, Y): Position & (Z): Mass
-	TArray<FVector> RenderDataArr;	
+	/**
+	 * @brief Seed of every random body, picked when the simulation starts, see FBodyDistribution::Generate
+	 */
+	uint64 RandomSeed = 0;
 	
 	TUniquePtr<TBarnesHutTree<ETreeBranchSize::QuadTree>> QuadTree;
+	TUniquePtr<TLinearQuadTree<ETreeBranchSize::QuadTree>> LinearQuadTree;
+
+	/**
+	 * @brief Whether the tree built this tick is the linear Morton tree rather than QuadTree
+	 */
+	bool bUseLinearTree = false;
+
+	/**
+	 * @brief Solver picked when NBodySim.Force.Solver doesn't override it
+	 */
+	ENBodySolver DefaultSolver = ENBodySolver::Auto;
+
+	/**
+	 * @brief Solver that ran this tick, never Auto
+	 */
+	ENBodySolver StepSolver = ENBodySolver::BarnesHut;
+
+	/**
+	 * @brief Whether the tree was rebuilt for this tick's bodies, Barnes Hut & the particle mesh's short range part
+	 */
+	bool bTreeIsCurrent = false;
+
+	/**
+	 * @brief Whether this tick only kicks the bodies starting a block time step, see FBlockTimeStepper
+	 */
+	bool bUseBlockTimeSteps = false;
+
+	FBlockTimeStepper BlockTimeStepper;
+
+	/**
+	 * @brief Quadrupole moment of every node of the tree built this tick, valid while bHasQuadrupoles is set
+	 */
+	TArray<FVector2f> NodeQuadrupoles;
+	bool bHasQuadrupoles = false;
+
+	FDirectForceSolver DirectSolver;
+	FFastMultipoleSolver FastMultipoleSolver;
+	FParticleMeshSolver ParticleMeshSolver;
+	FSolverCalibration SolverCalibration;
+
+	/**
+	 * @brief Runs the force pass when NBodySim.Threading.bWorkStealing is set
+	 */
+	TUniquePtr<FWorkStealingScheduler> Scheduler;
+
+	/**
+	 * @brief Interaction list scratch of every scheduler worker, indexed by worker
+	 */
+	TArray<FInteractionList> WorkerInteractions;
 
 	/**
 	 * @brief Check & adjust load when this timer is fired, gather FPS data in frames between timer ticks.
@@ -79,9 +294,18 @@ protected:
 
 	/**
 	 * @brief The total cost of simulating bodies during the last tick (Sum of body costs).
-	 * Used for load balancing threads.
 	 */
 	int TotalSimulationCost = 0;
+
+	/**
+	 * @brief The total number of tree nodes the force pass opened during the last tick, group walks count once.
+	 */
+	int TotalOpenedCells = 0;
+
+	/**
+	 * @brief Prefix sum of last tick's costs per force pass chunk, used to split the pass in equal cost slices.
+	 */
+	TArray<double> ChunkCostPrefix;
 	
 	TObjectPtr<UNiagaraComponent> NiagaraSystem = nullptr;
 	
@@ -100,9 +324,11 @@ public:
 	 * @param MinimumBodyMass Minimum mass of bodies
 	 * @param MaximumBodyMass Maximum mass of bodies
 	 * @param bShouldAutoLoad True: try to spawn as many bodies as possible while maintaining a specific fps target
+	 * @param Solver Force solver to run, unless overridden by NBodySim.Force.Solver
 	 */
 	virtual void InitializeDefaults(const TSubclassOf<ANiagaraActor>& Renderer, int NumStartingBodies, float Coefficient,
-		float MinimumBodyMass, float MaximumBodyMass, bool bShouldAutoLoad);
+		float MinimumBodyMass, float MaximumBodyMass, bool bShouldAutoLoad,
+		ENBodySolver Solver = ENBodySolver::Auto);
 
 	/**
 	 * @brief Sets the variable responsible for enabling/disabling the simulation on Tick.
@@ -115,9 +341,75 @@ public:
 	 * @return FQuadrantBounds describing the Bounding Box in 2D.
 	 */
 	FQuadrantBounds GetWorldBounds() const;
+
+	/**
+	 * @brief Returns a view of the tree built during the current tick, whichever backend built it.
+	 */
+	TQuadTreeView GetTreeView() const;
+
+	/**
+	 * @brief Returns every body index in the spatial order of the tree built during the current tick, or an empty
+	 * view if that tree doesn't order its bodies.
+	 */
+	TArrayView<const uint32> GetSpatialBodyOrder() const;
+
+	/**
+	 * @brief Returns where the body with the given spawn order index is stored, the index trees & walks know it by.
+	 */
+	FORCEINLINE int GetBodyStorageIndex(const int Index) const { return BodyOrder.GetBodyIndex(Index); }
+
+	/**
+	 * @brief Returns the scheduler running the force pass, null until the simulation starts.
+	 */
+	FORCEINLINE const FWorkStealingScheduler* GetScheduler() const { return Scheduler.Get(); }
+
+	/**
+	 * @brief Returns a copy of a simulated body, or a default body if the index is invalid.
+	 * Bodies are indexed in spawn order, which matches the render data whichever order they're simulated in.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "NBody")
+	FBodyDescriptor GetBody(int Index);
+
+	/**
+	 * @brief Overwrites a simulated body, does nothing if the index is invalid.
+	 * Bodies are indexed in spawn order, as in GetBody.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "NBody")
+	void SetBody(int Index, const FBodyDescriptor& Body);
 	
 	virtual void StartSimulation();
 
+	/**
+	 * @brief Starts the simulation without a camera, renderer or load timer, for benchmarks & other headless runs.
+	 * Bodies are spawned from InitializeDefaults' values, the simulation is only advanced through StepSimulation.
+	 * @param Bounds World bounds to simulate in
+	 * @param Seed Seed of the random bodies, the same seed always spawns the same bodies
+	 * @param InNumWorkers Number of workers to split passes across, including the calling thread
+	 * @param Distribution How the starting bodies are spread over the bounds
+	 */
+	virtual void StartHeadless(const FQuadrantBounds& Bounds, int32 Seed, int InNumWorkers,
+	                           EBodyDistribution Distribution = EBodyDistribution::Uniform);
+
+	FORCEINLINE const FSimulationStepTimings& GetLastStepTimings() const { return LastStepTimings; }
+
+	FORCEINLINE const FSimulationMemoryUsage& GetMemoryUsage() const { return MemoryUsage; }
+
+	FORCEINLINE const FSolverCalibration& GetSolverCalibration() const { return SolverCalibration; }
+
+	/**
+	 * @brief Returns the solver the last step ran.
+	 */
+	FORCEINLINE ENBodySolver GetStepSolver() const { return StepSolver; }
+
+	FORCEINLINE const FSimulationMemoryUsage& GetPeakMemoryUsage() const { return PeakMemoryUsage; }
+
+	FORCEINLINE float GetAccuracyCoefficient() const { return AccuracyCoefficient; }
+
+	/**
+	 * @brief Changes the Barnes Hut accuracy coefficient, applied from the next tree walk.
+	 */
+	FORCEINLINE void SetAccuracyCoefficient(const float Coefficient) { AccuracyCoefficient = Coefficient; }
+
 	/**
 	 * @brief Adjusts the program load with a target of simulating as many bodies as possible within a 60 fps average
 	 */
@@ -132,30 +424,167 @@ public:
 
 	FORCEINLINE virtual int NumBodies() { return Bodies.Num(); }
 
+	/**
+	 * @brief Hands the last frame to renderers without the data interface, as an array copy.
+	 */
 	virtual void UpdateRenderer();
 
+	/**
+	 * @brief Returns the latest published frame, only taken from the simulation on the first call of a game frame.
+	 * Game thread only. The frame stays valid & unchanged until the first call of the next game frame, Niagara is done
+	 * simulating by then, so the data interface can read it in place from its simulation threads.
+	 */
+	const FBodyRenderFrame& AcquireRenderFrame();
+
 	virtual void SimulateOneTick(float DeltaTime);
 
+	/**
+	 * @brief Starts the next simulation step as a task once the last one finished, never waits on it.
+	 * The finished steps' frames reach the renderer through RenderBuffers.
+	 */
+	virtual void TickAsyncSimulation(float DeltaTime);
+
+	/**
+	 * @brief Blocks until the simulation step running off the game thread, if any, is done.
+	 * Needed before touching bodies from the game thread in async mode.
+	 */
+	void WaitForSimulationTask();
+
+	/**
+	 * @brief Advances the simulation by one step & publishes the resulting frame, safe to run off the game thread.
+	 */
+	virtual void StepSimulation(float DeltaTime);
+
+	/**
+	 * @brief Adds the bodies the auto load decided on, game thread only.
+	 */
+	virtual void SpawnPendingBodies();
+
 	/**
 	 * @brief Distributes bodies into AsyncTasks running on the game thread pool.
-	 * Ideally this would be a custom thread pool, I'm not entirely sure what the overhead difference is.
+	 * Either through the work stealing scheduler, or one task per up front cost range (NBodySim.Threading.bWorkStealing).
+	 * Either way bodies are split into slices of equal cost along the tree's spatial order.
 	 * No locks, no atomics, the tree is pre-calculated and every subset of bodies is owned by the context of the thread
 	 * that works on it.
 	 */
 	virtual void BatchAndWaitBodyCalcTasks(float DeltaTime);
 
+	/**
+	 * @brief Same as BatchAndWaitBodyCalcTasks, but split per leaf bucket of the linear tree instead of per body.
+	 * Every bucket is walked once and the resulting interaction list is shared by all of its bodies.
+	 */
+	virtual void BatchAndWaitBucketCalcTasks(float DeltaTime);
+
+	/**
+	 * @brief Exact force pass, every body pair once, tiled & split across the scheduler's workers.
+	 */
+	virtual void BatchAndWaitDirectCalcTasks(float DeltaTime);
+
+	/**
+	 * @brief Fast multipole force pass, every pass split per level across the task graph workers.
+	 */
+	virtual void BatchAndWaitFastMultipoleCalcTasks(float DeltaTime);
+
+	/**
+	 * @brief Particle mesh force pass over the world bounds, plus the tree's short range part when
+	 * NBodySim.PM.bShortRange is set.
+	 */
+	virtual void BatchAndWaitParticleMeshCalcTasks(float DeltaTime);
+
+	/**
+	 * @brief Picks the solver for the next step, from NBodySim.Force.Solver, InitializeDefaults' solver or, when
+	 * automatic, the calibrated cost models of the direct & tree solvers.
+	 * Now & then picks the predicted slower of the two instead, to keep its model up to date.
+	 */
+	ENBodySolver SelectSolver();
+
+	/**
+	 * @brief Feeds the last step's timings to the cost model of the solver that ran & updates the crossover.
+	 */
+	void UpdateSolverCalibration();
+
+	/**
+	 * @brief Publishes the scheduler's worker stats of the last force pass.
+	 */
+	void UpdateWorkerStats();
+
+	/**
+	 * @brief Publishes the tree & force pass counters of the last step, to stats & the CSV profiler.
+	 */
+	void UpdateSimulationCounters();
+
+	/**
+	 * @brief Measures the containers' memory, updates the high water marks & publishes both as memory stats.
+	 * Runs on the simulation side, the only one resizing the containers.
+	 */
+	void UpdateMemoryStats();
+
+	/**
+	 * @brief Computes the quadrupole moments of the tree built this tick, walks then evaluate them on top of the
+	 * monopoles. Invalidated by the next tree build.
+	 */
+	void UpdateQuadrupoles();
+
+	/**
+	 * @brief Warps the bodies that left the world bounds back within them.
+	 */
+	void WarpBodies();
+
+	/**
+	 * @brief Sorts the bodies back into Morton order once they drifted far enough from it, see FSpatialBodyOrder.
+	 */
+	void ReorderBodies(float DeltaTime);
+
+	/**
+	 * @brief Warps the bodies back within bounds & rebuilds the tree for their positions, either serially or split
+	 * across the task graph workers depending on NBodySim.Tree.BuildMode.
+	 */
 	virtual void BatchAndWaitBuildTree(float DeltaTime);
 	
-	virtual void CalculateBodyVelocity(float DeltaTime, FBodyDescriptor& Body, const TQuadTreeNode& RootNode);
+	/**
+	 * @brief Accumulates the velocity change the tree applies to a body, walking the tree iteratively.
+	 * Intentionally not virtual so the whole walk can be inlined into the force pass.
+	 * @param DeltaTime Tick delta time
+	 * @param Body The body to update, SimCost is incremented by the number of interactions
+	 * @param BodyIndex Index of the body in Bodies, used to skip self interaction
+	 * @param Tree The tree to walk, accepted nodes also apply their quadrupole when it holds moments
+	 * @return What the walk accepted & opened
+	 */
+	FTreeWalkStats CalculateBodyVelocity(float DeltaTime, FBodyDescriptor& Body, uint32 BodyIndex,
+	                                     const TQuadTreeView& Tree);
+
+	/**
+	 * @brief Walks the tree with the same acceptance test as CalculateBodyVelocity, but only records the accepted
+	 * (pseudo) bodies so they can be evaluated in one go by FForceKernel.
+	 * @return What the walk accepted & opened
+	 */
+	FTreeWalkStats GatherInteractions(const FBodyDescriptor& Body, uint32 BodyIndex, const TQuadTreeView& Tree,
+	                                  FInteractionList& Interactions);
+
+	/**
+	 * @brief Accumulates the velocity change of every body in a bucket, from one shared walk for the far field and
+	 * direct interactions between the bucket's own bodies.
+	 * @param BucketNodeIndex Index of the bucket node in the tree
+	 * @param Tree The tree to walk, must hold leaf streams
+	 * @param Interactions Scratch list owned by the calling task
+	 * @return The summed cost of the bucket's bodies as accepted, & the nodes its shared walk opened
+	 */
+	FTreeWalkStats CalculateBucketVelocities(uint32 BucketNodeIndex, const TQuadTreeView& Tree, FInteractionList& Interactions);
 
 protected:
+	/**
+	 * @brief Creates the trees & scheduler for the current world bounds and spawns the starting bodies.
+	 */
+	void InitializeSimulationState(int32 Seed, int InNumWorkers, EBodyDistribution Distribution);
+
 	virtual void OnViewportResizedCallback(FViewport* Viewport, unsigned I);
 	virtual void UpdateCameraWorldBounds();
 
 #pragma region DEBUG
 	virtual void TickDebug(float DeltaTime);
 
-	virtual void DebugDrawTreeBounds(float DeltaTime, TQuadTreeNode& Node);
+	virtual void DebugDrawTreeBounds(float DeltaTime, const TQuadTreeView& Tree, const TQuadTreeNode& Node,
+	                                 const FQuadrantBounds& NodeBounds);
 
 	virtual void DebugDrawForceConnection(float DeltaTime, const FBodyDescriptor& Body1, const FBodyDescriptor& Body2, bool bIsPseudoBody = false);
 #pragma endregion 
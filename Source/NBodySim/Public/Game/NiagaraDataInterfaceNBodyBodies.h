@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NiagaraDataInterface.h"
+#include "Core/DataStructure/BodyRenderFrame.h"
+
+#include "NiagaraDataInterfaceNBodyBodies.generated.h"
+
+class UNBodySimulationSubsystem;
+
+/**
+ * @brief Per system instance state of the bodies data interface.
+ */
+struct FNDINBodyBodiesInstanceData
+{
+	TWeakObjectPtr<UNBodySimulationSubsystem> Subsystem;
+
+	// Frame taken this tick, read in place by the VM functions
+	const FBodyRenderFrame* Frame = nullptr;
+
+	// Bodies in the frame taken last tick, & how many more there are in this one
+	int NumPreviousBodies = 0;
+	int NumNewBodies = 0;
+};
+
+/**
+ * @brief Reads the simulated bodies straight from the simulation's render buffers, no array copy per frame.
+ * Bodies are addressed by stable index, the order they were spawned in, so an emitter that spawns GetNumNewBodies
+ * particles every tick keeps every particle on the same body without ever being reset.
+ * CPU simulations only.
+ */
+UCLASS(EditInlineNew, Category = "NBody", meta = (DisplayName = "NBody Bodies"))
+class NBODYSIM_API UNiagaraDataInterfaceNBodyBodies : public UNiagaraDataInterface
+{
+	GENERATED_BODY()
+
+public:
+	virtual void PostInitProperties() override;
+
+	virtual void GetFunctions(TArray<FNiagaraFunctionSignature>& OutFunctions) override;
+	virtual void GetVMExternalFunction(const FVMExternalFunctionBindingInfo& BindingInfo, void* InstanceData,
+	                                   FVMExternalFunction& OutFunc) override;
+	virtual bool CanExecuteOnTarget(ENiagaraSimTarget Target) const override
+	{
+		return Target == ENiagaraSimTarget::CPUSim;
+	}
+
+	virtual int32 PerInstanceDataSize() const override { return sizeof(FNDINBodyBodiesInstanceData); }
+	virtual bool InitPerInstanceData(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance) override;
+	virtual void DestroyPerInstanceData(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance) override;
+	virtual bool HasPreSimulateTick() const override { return true; }
+	virtual bool PerInstanceTick(void* PerInstanceData, FNiagaraSystemInstance* SystemInstance,
+	                             float DeltaSeconds) override;
+
+private:
+	/**
+	 * @brief Outputs the number of bodies in the frame.
+	 */
+	static void VMGetNumBodies(FVectorVMExternalFunctionContext& Context);
+
+	/**
+	 * @brief Outputs the number of bodies spawned since the last tick, the particles to spawn to keep up.
+	 */
+	static void VMGetNumNewBodies(FVectorVMExternalFunctionContext& Context);
+
+	/**
+	 * @brief Outputs the location & mass of the body with the given stable index, & whether there's such a body.
+	 */
+	static void VMGetBody(FVectorVMExternalFunctionContext& Context);
+};